@@ -24,7 +24,7 @@ and python programs (DAPLink Interface Firmware and pyDAPFlash)
 from struct import unpack
 from os.path import join
 from jinja2 import Template, StrictUndefined
-import sys, os, collections
+import sys, os, re, collections
 
 # TODO
 # FIXED LENGTH - remove and these (shrink offset to 4 for bkpt only)
@@ -32,29 +32,172 @@ import sys, os, collections
 ALGO_OFFSET = 0x20
 BLOB_START = 0x3FFF4000
 BLOB_HEADER = '0xE00ABE00, 0x062D780D, 0x24084068, 0xD3000040, 0x1E644058, 0x1C49D1FA, 0x2A001E52, 0x4770D1F2,'
-SP = BLOB_START + 2048
-PROG_PAGE_SIZE = 0x800
+
+# RAM layout after the blob: stack, then PAGE_BUFFERS buffers holding the
+# largest transfer of any region so the host can upload the next page while one
+# is being programmed. Transfers are limited to PAGE_BUFFER_SIZE unless the
+# programming page of the device is larger, or the algorithm exports
+# program_sector_if_changed, which takes a whole sector.
+# The stack is the maximum usage reported by the armlink callgraph plus
+# STACK_MARGIN, or STACK_SIZE when the build has no callgraph.
+PAGE_BUFFERS = 2
+PAGE_BUFFER_SIZE = 0x800
+STACK_SIZE = 0x800
+STACK_MARGIN = 0x100
+RAM_ALIGN = 8
+
+
+def align(value, alignment=RAM_ALIGN):
+    return (value + alignment - 1) & ~(alignment - 1)
+
+
+class RamLayout(object):
+    def __init__(self, code_size, data_size, stack_usage, buffer_size):
+        self.code_size = code_size
+        self.data_size = data_size
+        self.stack_usage = stack_usage
+        if stack_usage is None:
+            self.stack_size = STACK_SIZE
+        else:
+            self.stack_size = align(stack_usage + STACK_MARGIN)
+        self.blob_end = BLOB_START + ALGO_OFFSET + code_size + data_size
+        self.stack_pointer = align(self.blob_end) + self.stack_size
+        self.buffer_size = buffer_size
+        self.page_buffers = [self.stack_pointer + i * align(buffer_size) for i in range(PAGE_BUFFERS)]
+        self.end = self.page_buffers[-1] + buffer_size
+
+    def printInfo(self):
+        print 'RAM layout:'
+        print '----------------------------'
+        print 'Blob:           0x%08x - 0x%08x (code %u, data %u)' % (BLOB_START, self.blob_end, self.code_size, self.data_size)
+        if self.stack_usage is None:
+            print 'Stack:          0x%08x (%u, no callgraph)' % (self.stack_pointer, self.stack_size)
+        else:
+            print 'Stack:          0x%08x (%u, measured %u)' % (self.stack_pointer, self.stack_size, self.stack_usage)
+        for i in range(len(self.page_buffers)):
+            print 'Page buffer[%d]: 0x%08x (%u)' % (i, self.page_buffers[i], self.buffer_size)
+        print 'RAM used:       %u' % (self.end - BLOB_START)
+
+
+def stack_usage(path):
+    ''' Maximum stack usage from the armlink callgraph, None if there is none. '''
+    if not os.path.isfile(path):
+        return None
+    match = re.search(r'Maximum Stack Usage\s*=\s*(\d+)\s*bytes', open(path).read())
+    if not match:
+        return None
+    return int(match.group(1))
+
+
+# Entry points exported in the blob. Algorithms built with the Keil FlashOS names
+# are mapped onto the same keys as the ones using the FlashPrg.h names.
+ALGO_FUNCTIONS = {
+    'init'          : 'init',
+    'uninit'        : 'uninit',
+    'eraseAll'      : 'eraseAll',
+    'erase_sector'  : 'erase_sector',
+    'erase_sector_start' : 'erase_sector_start',
+    'erase_poll'    : 'erase_poll',
+    'erase_range'   : 'erase_range',
+    'program_page'  : 'program_page',
+    'program_pages' : 'program_pages',
+    'verify'        : 'verify',
+    'blank_check'   : 'blank_check',
+    'compute_crc'   : 'compute_crc',
+    'program_sector_if_changed' : 'program_sector_if_changed',
+    'get_geometry'  : 'get_geometry',
+    'Init'          : 'init',
+    'UnInit'        : 'uninit',
+    'EraseChip'     : 'eraseAll',
+    'EraseSector'   : 'erase_sector',
+    'ProgramPage'   : 'program_page',
+    'Verify'        : 'verify',
+    'BlankCheck'    : 'blank_check',
+}
+
+# struct FlashDeviceV2 (FlashOS.h) is told apart by the low byte of vers. FlashDev.c
+# exports it as FlashDeviceV2, next to the version 1 FlashDevice uVision reads
+VERS2 = 2
+DEVICE_V2_SYMBOL = 'FlashDeviceV2'
+
+# FlashDeviceV2.caps bits (FLASH_CAP_ in FlashOS.h) and the entry points they
+# stand for. Version 1 descriptors get the bits of the entry points exported.
+CAPABILITIES = [
+    (1 << 0, 'blank_check', ['blank_check']),
+    (1 << 1, 'crc', ['compute_crc']),
+    (1 << 2, 'multi_page', ['program_pages']),
+    (1 << 3, 'async_erase', ['erase_sector_start', 'erase_poll']),
+    (1 << 4, 'compressed', []),
+    (1 << 5, 'geometry', ['get_geometry']),
+]
+
+def capabilities(caps, func):
+    ''' The capability bits whose entry points are all in the blob. caps None
+    (a version 1 descriptor) stands for all of them. '''
+    result = 0
+    for bit, name, entry_points in CAPABILITIES:
+        if caps is not None and not (caps & bit):
+            continue
+        if not all(entry_point in func for entry_point in entry_points):
+            if caps is not None:
+                print 'Warning: capability %s without %s' % (name, ', '.join(entry_points))
+            continue
+        if entry_points or caps is not None:
+            result |= bit
+    return result
+
+
+class FlashRegion(object):
+    ''' Flash from one entry of the sector table to the next, or one region of a
+    version 2 descriptor. ProgramPage is called with whole pages that don't span
+    a sector, up to max_program_length bytes. '''
+    def __init__(self, start, end, sector_size, page_size, erased_value):
+        self.start = start
+        self.end = end
+        self.erased_value = erased_value
+        self.sector_size = sector_size
+        self.sector_count = (end - start) // sector_size
+        self.page_size = min(page_size, sector_size)
+        self.min_program_length = self.page_size
+        pages = max(min(sector_size, PAGE_BUFFER_SIZE) // self.page_size, 1)
+        self.max_program_length = pages * self.page_size
+
 
 class FlashInfo(object):
-    def __init__(self, path):
+    def __init__(self, path, offset=0):
         with open(path, 'rb') as f:
             # Read Device Information struct (defined in FlashOS.H, declared in FlashDev.c).
-            self.version  = unpack('H', f.read(2))[0]
+            f.seek(offset)
+            self.version  = unpack('<H', f.read(2))[0]
             self.devName  = f.read(128).split(b'\0',1)[0]
-            self.devType  = unpack('H', f.read(2))[0]
-            self.devAddr  = unpack('L', f.read(4))[0]
-            self.szDev    = unpack('L', f.read(4))[0]
-            self.szPage   = unpack('L', f.read(4))[0]
-            skipped = f.read(4)
+            self.devType  = unpack('<H', f.read(2))[0]
+            self.devAddr  = unpack('<L', f.read(4))[0]
+            self.szDev    = unpack('<L', f.read(4))[0]
+            self.szPage   = unpack('<L', f.read(4))[0]
+            skipped_res = f.read(4)
             self.valEmpty = unpack('B', f.read(1))[0]
             skipped = f.read(3)
-            self.toProg   = unpack('L', f.read(4))[0]
-            self.toErase  = unpack('L', f.read(4))[0]
+            self.toProg   = unpack('<L', f.read(4))[0]
+            self.toErase  = unpack('<L', f.read(4))[0]
             self.sectSize = []
             self.sectAddr = []
+            self.caps = None
+            self.regions = []
+            if (self.version & 0xFF) == VERS2:
+                # caps takes the place of the reserved word, the regions follow
+                # their count
+                self.caps = unpack('<L', skipped_res)[0]
+                for i in range(unpack('<L', f.read(4))[0]):
+                    adr, size, sector, page, empty = unpack('<LLLLB3x', f.read(20))
+                    self.sectSize.append(sector)
+                    self.sectAddr.append(adr)
+                    self.regions.append(FlashRegion(self.devAddr + adr, self.devAddr + adr + size,
+                                                    sector, page, empty))
+                return
+
             while 1:
-                addr = unpack('L', f.read(4))[0]
-                size = unpack('L', f.read(4))[0]
+                size = unpack('<L', f.read(4))[0]
+                addr = unpack('<L', f.read(4))[0]
                 if addr == 0xffffffff:
                     break
 
@@ -65,6 +208,16 @@ class FlashInfo(object):
                     self.sectSize.append(size)
                     self.sectAddr.append(addr)
 
+        # Sector addresses are offsets from the start of the device. Every entry
+        # runs up to the next one, flash with gaps needs a version 2 descriptor
+        for i in range(len(self.sectSize)):
+            start = self.devAddr + self.sectAddr[i]
+            if i + 1 < len(self.sectAddr):
+                end = self.devAddr + self.sectAddr[i + 1]
+            else:
+                end = self.devAddr + self.szDev
+            self.regions.append(FlashRegion(start, end, self.sectSize[i], self.szPage, self.valEmpty))
+
     def printInfo(self):
         print 'Extracted device information:'
         print '----------------------------'
@@ -77,8 +230,15 @@ class FlashInfo(object):
         print 'valEmpty:       0x%02x' % (self.valEmpty)
         print 'Timeout Prog:   %u' % (self.toProg)
         print 'Timeout Erase:  %u' % (self.toErase)
+        if self.caps is not None:
+            print 'Capabilities:   0x%08x' % (self.caps)
         for i in range(len(self.sectSize)):
             print 'Sectors[%d]: { 0x%08x, 0x%08x }' % (i, self.sectSize[i], self.sectAddr[i])
+        for i in range(len(self.regions)):
+            region = self.regions[i]
+            print 'Region[%d]:  0x%08x - 0x%08x page %u, program %u - %u, erased 0x%02x' % (i, region.start,
+                region.end, region.page_size, region.min_program_length, region.max_program_length,
+                region.erased_value)
 
 
 def generate_blob(template_path_file, ext, data):
@@ -95,14 +255,32 @@ def generate_blob(template_path_file, ext, data):
     return
 
 
+def descriptor_offset(path, name):
+    ''' Offset of the descriptor exported as name in DevDscr, the section holding
+    it starts at the lowest address of its symbols. None if it isn't exported. '''
+    symbols = []
+    with open(path, 'rb') as f:
+        for line in f:
+            t = line.strip().split()
+            if len(t) >= 5 and t[2].startswith('0x') and t[4].isdigit():
+                symbols.append((t[1], int(t[2], 16), t[4]))
+    for symbol, loc, sec in symbols:
+        if symbol == name:
+            return loc - min(l for n, l, s in symbols if s == sec)
+    return None
+
+
 def decode_axf(string):
     ELF_PATH = string
     DEV_DSCR_PATH = join(ELF_PATH, 'DevDscr')
     PRG_CODE_PATH = join(ELF_PATH, 'PrgCode')
+    PRG_DATA_PATH = join(ELF_PATH, 'PrgData')
     ALGO_SYM_PATH = join(ELF_PATH, 'symbols')
+    CALLGRAPH_PATH = ELF_PATH + '.htm'
     
-    # print some info about the build
-    flash_info = FlashInfo(DEV_DSCR_PATH)
+    # print some info about the build, from the version 2 descriptor if there is one
+    offset = descriptor_offset(ALGO_SYM_PATH, DEVICE_V2_SYMBOL)
+    flash_info = FlashInfo(DEV_DSCR_PATH, offset or 0)
     flash_info.printInfo()
     
     # prepare data to write to the template
@@ -112,11 +290,29 @@ def decode_axf(string):
     dic['prog_header'] = BLOB_HEADER
     dic['header_size'] = '0x%08x' % ALGO_OFFSET
     dic['entry'] = '0x%08x' % BLOB_START
-    dic['prog_page_size'] = '0x%08x' % PROG_PAGE_SIZE
-    dic['stack_pointer'] = '0x%08x' % SP
+    dic['prog_page_size'] = '0x%08x' % flash_info.regions[0].page_size
+    dic['min_program_length'] = '0x%08x' % flash_info.regions[0].min_program_length
+    dic['max_program_length'] = '0x%08x' % flash_info.regions[0].max_program_length
+    dic['erased_value'] = '0x%02x' % flash_info.valEmpty
+    dic['program_timeout'] = flash_info.toProg
+    dic['erase_timeout'] = flash_info.toErase
+    dic['sectors'] = []
+    dic['regions'] = []
+    for region in flash_info.regions:
+        dic['sectors'].append(('0x%08x' % region.sector_size, '0x%08x' % region.start, region.sector_count))
+        dic['regions'].append({
+            'start' : '0x%08x' % region.start,
+            'length' : '0x%08x' % (region.end - region.start),
+            'sector_size' : '0x%08x' % region.sector_size,
+            'page_size' : '0x%08x' % region.page_size,
+            'min_program_length' : '0x%08x' % region.min_program_length,
+            'max_program_length' : '0x%08x' % region.max_program_length,
+            'erased_value' : '0x%02x' % region.erased_value,
+        })
     dic['mem'] = ''
     dic['func'] = {}
     dic['static_base'] = ''
+    dic['stats'] = ''
 
     with open(PRG_CODE_PATH, 'rb') as f1:
         nb_bytes = ALGO_OFFSET
@@ -132,6 +328,7 @@ def decode_axf(string):
             bytes_read = f1.read(1024)
                 
         # Address of the functions within the flash algorithm
+        symbols = []
         with open(ALGO_SYM_PATH, 'rb') as f2:
             for line in list(f2):
                 t = line.strip().split()
@@ -139,15 +336,49 @@ def decode_axf(string):
                     continue
                 
                 name, loc, sec = t[1], t[2], t[4]
-                #if name in ['EraseChip', 'EraseSector', 'Init', 'ProgramPage', 'UnInit', 'Verify']:
-                if name in ['eraseAll', 'init', 'verify', 'program_page', 'erase_sector', 'uninit']:
+                if name in ALGO_FUNCTIONS:
                     addr = BLOB_START + ALGO_OFFSET + int(loc, 16)
-                    dic['func'].update({'%s' % name : '0x%08X' % addr})
+                    dic['func'].update({'%s' % ALGO_FUNCTIONS[name] : '0x%08X' % addr})
+
+                # flash_stats_t block of flash_stats.h
+                if name == 'flash_stats':
+                    dic['stats'] = '0x%08x' % (BLOB_START + ALGO_OFFSET + int(loc, 16))
 
                 if name == '$d.realdata':
                     if sec == '2':
                         dic['static_base'] = '0x%08x' % int(loc, 16)
 
+                if len(t) >= 8 and sec.isdigit() and sec != '0':
+                    try:
+                        symbols.append((name, int(loc, 16), sec, int(t[7], 16)))
+                    except ValueError:
+                        pass
+
+    # RW and ZI data follow the code. ZI isn't in PrgData, so the end of the data
+    # comes from the symbols outside the code and device description sections.
+    code_size = os.path.getsize(PRG_CODE_PATH)
+    data_end = code_size
+    if os.path.isfile(PRG_DATA_PATH):
+        data_end += os.path.getsize(PRG_DATA_PATH)
+    skip_sections = set(sec for name, loc, sec, size in symbols if name in ALGO_FUNCTIONS)
+    skip_sections.update(sec for name, loc, sec, size in symbols if name in ('FlashDevice', DEVICE_V2_SYMBOL))
+    for name, loc, sec, size in symbols:
+        if sec not in skip_sections:
+            data_end = max(data_end, loc + size)
+
+    dic['capabilities'] = '0x%08x' % capabilities(flash_info.caps, dic['func'])
+
+    buffer_size = max(region.max_program_length for region in flash_info.regions)
+    if 'program_sector_if_changed' in dic['func']:
+        buffer_size = max([buffer_size] + [region.sector_size for region in flash_info.regions])
+    layout = RamLayout(code_size, data_end - code_size, stack_usage(CALLGRAPH_PATH), buffer_size)
+    layout.printInfo()
+    if dic['stats']:
+        print 'Statistics:     %s' % dic['stats']
+    dic['stack_pointer'] = '0x%08x' % layout.stack_pointer
+    dic['page_buffers'] = ['0x%08x' % buf for buf in layout.page_buffers]
+    dic['page_buffer_size'] = '0x%08x' % layout.buffer_size
+
     # order the flash programming functions - known order 
     #dic['func'] = collections.OrderedDict(sorted(dic['func'].items()))
     return dic
@@ -26,6 +26,7 @@
 #endif
 
 #define VERS        1       // Interface Version 1.01
+#define VERS2       2       // Interface Version 2, struct FlashDeviceV2
 #define NAME_MAX    128     // Max size of the routine name
 #define PAGE_MAX    65536   // Max Page Size for Programming
 #define SECTOR_NUM  512     // Max Number of Sector Items
@@ -39,6 +40,14 @@
 #define EXT32BIT    4
 #define EXTSPI      5
 
+// FlashDeviceV2.caps optional entry points and features
+#define FLASH_CAP_BLANK_CHECK   (1u << 0)   // BlankCheck
+#define FLASH_CAP_CRC           (1u << 1)   // compute_crc
+#define FLASH_CAP_MULTI_PAGE    (1u << 2)   // program_pages
+#define FLASH_CAP_ASYNC_ERASE   (1u << 3)   // erase_sector_start and erase_poll
+#define FLASH_CAP_COMPRESSED    (1u << 4)   // program_page takes compressed data
+#define FLASH_CAP_GEOMETRY      (1u << 5)   // get_geometry
+
 /**
     @struct FlashSector
     @brief  A structure to describe the size and start address of a flash sector
@@ -67,6 +76,57 @@ struct FlashDevice {
     struct FlashSector sectors[SECTOR_NUM]; /*!< Entries to describe flash memory layout */
 };
 
+/**
+    @struct FlashRegion
+    @brief  A structure to describe a range of flash with uniform sectors and pages
+ */
+struct FlashRegion {
+    uint32_t adrRegion;     /*!< Address of Region, offset from devAdr */
+    uint32_t szRegion;      /*!< Region Size in Bytes */
+    uint32_t szSector;      /*!< Sector Size in Bytes */
+    uint32_t szPage;        /*!< Programming Page Size */
+    uint8_t  valEmpty;      /*!< Content of Erased Memory */
+};
+
+/**
+    @struct FlashDeviceV2
+    @brief  A FlashDevice with a table of regions instead of sectors and the
+        optional entry points of the driver. The fields up to toErase match
+        struct FlashDevice, vers is (0x0100+VERS2). numRegions struct
+        FlashRegion follow the structure, FLASH_DEVICE_V2_STRUCT() declares both.
+        FlashDev.c exports it as FlashDeviceV2, next to the struct FlashDevice
+        FlashDevice that tools only reading version 1, like uVision, need.
+ */
+struct FlashDeviceV2 {
+    uint16_t vers;          /*!< Version Number and Architecture */
+    char devName[NAME_MAX]; /*!< Device Name and Description */
+    uint16_t devType;       /*!< Device Type: ONCHIP, EXT8BIT, EXT16BIT, ... */
+    uint32_t devAdr;        /*!< Default Device Start Address */
+    uint32_t szDev;         /*!< Total Size of Device */
+    uint32_t szPage;        /*!< Largest Programming Page Size of the regions */
+    uint32_t caps;          /*!< FLASH_CAP_ bits */
+    uint8_t  valEmpty;      /*!< Content of Erased Memory of the first region */
+    uint32_t toProg;        /*!< Time Out of Program Page Function */
+    uint32_t toErase;       /*!< Time Out of Erase Sector Function */
+    uint32_t numRegions;    /*!< Number of Regions that follow */
+};
+
+/** Type of a struct FlashDeviceV2 in dev followed by its n regions */
+#define FLASH_DEVICE_V2_STRUCT(n) struct { struct FlashDeviceV2 dev; struct FlashRegion regions[n]; }
+
+/** The regions following the struct FlashDeviceV2 at dev */
+#define FLASH_REGIONS(dev)      ((const struct FlashRegion *)((const struct FlashDeviceV2 *)(dev) + 1))
+
+/**
+    @struct FlashGeometry
+    @brief  The flash a part really has, filled in by get_geometry. Parts of a
+        family can share an algorithm built for the largest of them.
+ */
+struct FlashGeometry {
+    uint32_t szPage;        /*!< Page Size in Bytes, the unit of EraseSector */
+    uint32_t numPages;      /*!< Number of Pages from devAdr */
+};
+
 #ifdef __cplusplus
   }
 #endif
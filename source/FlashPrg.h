@@ -20,6 +20,8 @@
 #define FLASHPRG_H
 
 #include "stdint.h"
+#include "flash_diff.h"
+#include "flash_stats.h"
 
 #ifdef __cplusplus
   extern "C" {
@@ -58,6 +60,26 @@ uint32_t eraseAll(void);
  */
 uint32_t erase_sector(uint32_t adr);
 
+/** Start erasing a single sector of memory without waiting for it
+    No other function may be called until erase_poll() stops returning 1.
+    @param adr address of a sector to erase
+    @return 0 once the erase has been started, an error code otherwise
+ */
+uint32_t erase_sector_start(uint32_t adr);
+
+/** Poll the erase started by erase_sector_start()
+    @return 0 when the sector is erased, 1 while the erase is running, an error
+        code otherwise
+ */
+uint32_t erase_poll(void);
+
+/** Erase all sectors covering an address range
+    @param adr address to start erasing from
+    @param sz the amount of memory to erase
+    @return 0 on success, an error code otherwise
+ */
+uint32_t erase_range(uint32_t adr, uint32_t sz);
+
 /** Program data into memory
     @param adr address to start programming from
     @param sz the amount of data to program
@@ -66,6 +88,14 @@ uint32_t erase_sector(uint32_t adr);
  */
 uint32_t program_page(uint32_t adr, uint32_t sz, uint32_t *buf);
 
+/** Program any number of pages in one call
+    @param adr address to start programming from
+    @param sz the amount of data to program, may span pages and sectors
+    @param buf memory contents to be programmed
+    @return adr + sz on success, the first address that failed otherwise
+ */
+uint32_t program_pages(uint32_t adr, uint32_t sz, uint32_t *buf);
+
 /** Verify contents in memory
     @param adr start address of the verification
     @param sz the amount of data to be verified
@@ -74,6 +104,27 @@ uint32_t program_page(uint32_t adr, uint32_t sz, uint32_t *buf);
  */
 uint32_t verify(uint32_t adr, uint32_t sz, uint32_t *buf);
 
+/** Compute the CRC-32 of every sector in a range of memory
+    @param adr address to start from
+    @param sz the amount of memory, may span any number of sectors
+    @param crc receives one CRC-32 (see crc32()) per sector, the first and
+        last ones only cover the part of their sector inside the range
+    @return 0 on success, an error code otherwise
+ */
+uint32_t compute_crc(uint32_t adr, uint32_t sz, uint32_t *crc);
+
+/** Program a sector only where its contents differ
+    @param adr start address of a sector
+    @param sz the amount of data, at most one sector. The rest of the sector
+        is kept. If the sector needs an erase, the rest of it has to be blank,
+        otherwise nothing is done and FLASH_ACTION_FAILED is returned.
+    @param buf memory contents to be programmed
+    @return 0 if the sector already holds the data, otherwise FLASH_ACTION_ERASED
+        and FLASH_ACTION_PROGRAMMED for what was done (see flash_diff.h) and
+        FLASH_ACTION_FAILED on errors
+ */
+uint32_t program_sector_if_changed(uint32_t adr, uint32_t sz, uint32_t *buf);
+
 #ifdef __cplusplus
   }
 #endif
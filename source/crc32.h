@@ -0,0 +1,40 @@
+/* Flash OS Routines
+ * Copyright (c) 2009-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file crc32.h */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+/** Update a CRC-32 (IEEE 802.3, the zlib crc32) with a block of memory
+    @param crc CRC of the preceding data, 0 to start
+    @param data memory to add, read a word at a time where aligned
+    @param sz the amount of memory to add
+    @return the updated CRC
+ */
+uint32_t crc32(uint32_t crc, const void *data, uint32_t sz);
+
+#ifdef __cplusplus
+  }
+#endif
+
+#endif
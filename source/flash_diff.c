@@ -0,0 +1,54 @@
+/* Flash OS Routines
+ * Copyright (c) 2009-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file flash_diff.c */
+
+#include "flash_diff.h"
+
+uint32_t flash_diff(const void *flash, const void *buf, uint32_t sz, uint32_t unit)
+{
+    const volatile uint32_t *current = (const volatile uint32_t *)flash;
+    const uint32_t *data = (const uint32_t *)buf;
+    uint32_t unitWords = unit ? (unit / 4) : 1;
+    uint32_t words = sz / 4;
+    uint32_t actions = 0;
+
+    for (uint32_t i = 0; i < words; i += unitWords)
+    {
+        uint32_t changed = 0;
+        uint32_t blank = 1;
+        for (uint32_t j = i; (j < i + unitWords) && (j < words); j++)
+        {
+            uint32_t word = current[j];
+            changed |= word ^ data[j];
+            blank &= (word == FLASH_ERASED_WORD);
+            // Bits that have to go from 0 to 1
+            if (!unit && (~word & data[j]))
+            {
+                return FLASH_ACTION_ERASED | FLASH_ACTION_PROGRAMMED;
+            }
+        }
+        if (changed)
+        {
+            if (unit && !blank)
+            {
+                return FLASH_ACTION_ERASED | FLASH_ACTION_PROGRAMMED;
+            }
+            actions = FLASH_ACTION_PROGRAMMED;
+        }
+    }
+    return actions;
+}
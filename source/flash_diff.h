@@ -0,0 +1,67 @@
+/* Flash OS Routines
+ * Copyright (c) 2009-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file flash_diff.h */
+
+#ifndef FLASH_DIFF_H
+#define FLASH_DIFF_H
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+/** @name Actions reported by program_sector_if_changed()
+    0 means the sector already held the data.
+ */
+/*@{*/
+#define FLASH_ACTION_ERASED     (1u << 0)   /*!< The sector was erased */
+#define FLASH_ACTION_PROGRAMMED (1u << 1)   /*!< Data was programmed */
+#define FLASH_ACTION_FAILED     (1u << 31)  /*!< Invalid arguments or a flash operation failed */
+/*@}*/
+
+/** A word of erased flash, FlashDevice.valEmpty in every byte. All of the
+    algorithms erase to 0xFF.
+ */
+#define FLASH_ERASED_WORD       0xFFFFFFFFu
+
+/** Leave program units that hold the erased value alone. After an erase they
+    already read back as FLASH_ERASED_WORD, so padding and the gaps of sparse
+    images cost no program operations. Set to 0 to program every unit.
+ */
+#ifndef FLASH_PROGRAM_SKIP_ERASED
+#define FLASH_PROGRAM_SKIP_ERASED   1
+#endif
+
+/** Compare new contents with flash a word at a time
+    @param flash memory mapped flash, word aligned
+    @param buf new contents, word aligned
+    @param sz the amount of memory to compare, a multiple of 4
+    @param unit program unit in bytes. A unit that differs can be programmed
+        without an erase only if it is blank. 0 if words can be programmed
+        again as long as bits only change from 1 to 0.
+    @return 0 if the contents match, FLASH_ACTION_PROGRAMMED if the changes can
+        be programmed over the current contents, FLASH_ACTION_ERASED |
+        FLASH_ACTION_PROGRAMMED if they need an erase first
+ */
+uint32_t flash_diff(const void *flash, const void *buf, uint32_t sz, uint32_t unit);
+
+#ifdef __cplusplus
+  }
+#endif
+
+#endif
@@ -0,0 +1,146 @@
+/* Flash OS Routines
+ * Copyright (c) 2009-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file flash_stats.c */
+
+#include "flash_stats.h"
+
+#define DEMCR               (*(volatile uint32_t *)0xE000EDFCu)
+#define DEMCR_TRCENA        (1u << 24)
+#define DWT_CTRL            (*(volatile uint32_t *)0xE0001000u)
+#define DWT_CTRL_CYCCNTENA  (1u << 0)
+#define DWT_CTRL_NOCYCCNT   (1u << 25)
+#define DWT_CYCCNT          (*(volatile uint32_t *)0xE0001004u)
+
+#define SYST_CSR            (*(volatile uint32_t *)0xE000E010u)
+#define SYST_CSR_ENABLE     (1u << 0)
+#define SYST_CSR_CLKSOURCE  (1u << 2)
+#define SYST_CSR_COUNTFLAG  (1u << 16)
+#define SYST_RVR            (*(volatile uint32_t *)0xE000E014u)
+#define SYST_CVR            (*(volatile uint32_t *)0xE000E018u)
+#define SYST_MAX            0x00FFFFFFu
+
+// Zero initialised data isn't cleared when the blob is loaded, the block is
+// set up on the first call that doesn't find FLASH_STATS_MAGIC in it
+flash_stats_t flash_stats;
+
+static uint32_t s_depth;
+static uint32_t s_entry;
+static uint32_t s_start;
+static uint32_t s_wait;
+#if FLASH_STATS_TIMER == FLASH_STATS_TIMER_SYSTICK
+static uint32_t s_periods;
+#endif
+
+static void timer_start(void)
+{
+    flash_stats.timer = FLASH_STATS_TIMER;
+#if FLASH_STATS_TIMER == FLASH_STATS_TIMER_DWT
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+    if (DWT_CTRL & DWT_CTRL_NOCYCCNT)
+    {
+        flash_stats.timer = FLASH_STATS_TIMER_NONE;
+    }
+#elif FLASH_STATS_TIMER == FLASH_STATS_TIMER_SYSTICK
+    // Free running from SYST_MAX without the interrupt. SysTick is optional in
+    // ARMv6-M and reads as zero where it isn't implemented
+    SYST_CSR = 0;
+    SYST_RVR = SYST_MAX;
+    SYST_CVR = 0;
+    SYST_CSR = SYST_CSR_CLKSOURCE | SYST_CSR_ENABLE;
+    s_periods = 0;
+    if (SYST_RVR == 0)
+    {
+        flash_stats.timer = FLASH_STATS_TIMER_NONE;
+    }
+#endif
+}
+
+uint32_t flash_stats_now(void)
+{
+#if FLASH_STATS_TIMER == FLASH_STATS_TIMER_DWT
+    return DWT_CYCCNT;
+#elif FLASH_STATS_TIMER == FLASH_STATS_TIMER_SYSTICK
+    // Count the reloads to extend the 24 bit down counter. A reload after the
+    // first read of the counter is picked up by the next call, so the periods
+    // are only complete if the timer is read at least once per period. Busy
+    // waits read it with flash_stats_poll()
+    uint32_t count = SYST_CVR;
+    if (SYST_CSR & SYST_CSR_COUNTFLAG)
+    {
+        s_periods++;
+        count = SYST_CVR;
+    }
+    return (s_periods << 24) | (SYST_MAX - count);
+#elif FLASH_STATS_TIMER == FLASH_STATS_TIMER_HOST
+    return flash_stats_host_cycles();
+#else
+    return 0;
+#endif
+}
+
+void flash_stats_begin(uint32_t entry)
+{
+    // Init starts every sequence of calls
+    uint32_t restart = (entry == FLASH_STATS_INIT);
+
+    if (flash_stats.magic != FLASH_STATS_MAGIC)
+    {
+        uint32_t *word = (uint32_t *)&flash_stats;
+        for (uint32_t i = 0; i < sizeof(flash_stats) / 4; i++)
+        {
+            word[i] = 0;
+        }
+        flash_stats.magic = FLASH_STATS_MAGIC;
+        restart = 1;
+    }
+    if (restart)
+    {
+        s_depth = 0;
+        timer_start();
+    }
+    if (s_depth++ == 0)
+    {
+        s_entry = entry;
+        s_wait = 0;
+        s_start = flash_stats_now();
+    }
+}
+
+uint32_t flash_stats_end(uint32_t result)
+{
+    if ((s_depth == 0) || (--s_depth != 0))
+    {
+        return result;
+    }
+
+    uint32_t cycles = flash_stats_now() - s_start;
+    flash_stats_entry_t *stats = &flash_stats.entries[s_entry];
+    stats->calls++;
+    stats->cycles += cycles;
+    stats->wait_cycles += s_wait;
+    if (cycles > stats->max_cycles)
+    {
+        stats->max_cycles = cycles;
+    }
+    return result;
+}
+
+void flash_stats_wait(uint32_t start)
+{
+    s_wait += flash_stats_now() - start;
+}
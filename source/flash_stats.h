@@ -0,0 +1,132 @@
+/* Flash OS Routines
+ * Copyright (c) 2009-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file flash_stats.h */
+
+#ifndef FLASH_STATS_H
+#define FLASH_STATS_H
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+/** flash_stats_t.magic of an initialised block, changes with the layout */
+#define FLASH_STATS_MAGIC           0x46535432u     /* "FST2" */
+
+/** @name Timers behind the cycle counts, flash_stats_t.timer */
+/*@{*/
+#define FLASH_STATS_TIMER_NONE      0   /*!< Only calls and bytes are counted */
+#define FLASH_STATS_TIMER_DWT       1   /*!< DWT CYCCNT, core clock cycles */
+#define FLASH_STATS_TIMER_SYSTICK   2   /*!< SysTick on the core clock, for ARMv6-M */
+#define FLASH_STATS_TIMER_HOST      3   /*!< flash_stats_host_cycles(), for host builds */
+/*@}*/
+
+#ifndef FLASH_STATS_TIMER
+#if defined(__ARM_ARCH_6M__) || defined(__TARGET_ARCH_6S_M)
+#define FLASH_STATS_TIMER           FLASH_STATS_TIMER_SYSTICK
+#elif defined(__arm__) || defined(__CC_ARM)
+#define FLASH_STATS_TIMER           FLASH_STATS_TIMER_DWT
+#else
+#define FLASH_STATS_TIMER           FLASH_STATS_TIMER_NONE
+#endif
+#endif
+
+/** @name Entry points, index of flash_stats_t.entries */
+/*@{*/
+#define FLASH_STATS_INIT                        0
+#define FLASH_STATS_UNINIT                      1
+#define FLASH_STATS_ERASE_CHIP                  2
+#define FLASH_STATS_ERASE_SECTOR                3
+#define FLASH_STATS_ERASE_SECTOR_START          4
+#define FLASH_STATS_ERASE_POLL                  5
+#define FLASH_STATS_ERASE_RANGE                 6
+#define FLASH_STATS_PROGRAM_PAGE                7
+#define FLASH_STATS_PROGRAM_PAGES               8
+#define FLASH_STATS_PROGRAM_SECTOR_IF_CHANGED   9
+#define FLASH_STATS_VERIFY                      10
+#define FLASH_STATS_BLANK_CHECK                 11
+#define FLASH_STATS_COMPUTE_CRC                 12
+#define FLASH_STATS_GET_GEOMETRY                13
+#define FLASH_STATS_ENTRIES                     14
+/*@}*/
+
+/** Counters of one entry point. Calls made by another entry point are
+    accounted to the outer one.
+ */
+typedef struct {
+    uint32_t calls;             /*!< Completed calls */
+    uint32_t cycles;            /*!< Cycles of all calls */
+    uint32_t max_cycles;        /*!< Cycles of the longest call */
+    uint32_t wait_cycles;       /*!< Cycles spent polling a busy flash controller */
+} flash_stats_entry_t;
+
+/** Statistics of the algorithm. The host finds the block at the address the
+    generator exports and reads it after a session.
+ */
+typedef struct {
+    uint32_t magic;             /*!< FLASH_STATS_MAGIC */
+    uint32_t timer;             /*!< FLASH_STATS_TIMER_ of the cycle counts */
+    uint32_t bytes_programmed;  /*!< Bytes written to flash */
+    uint32_t bytes_erased;      /*!< Bytes of the sectors, banks or chips erased */
+    flash_stats_entry_t entries[FLASH_STATS_ENTRIES];
+} flash_stats_t;
+
+extern flash_stats_t flash_stats;
+
+/** Start accounting a call, the first statement of every entry point
+    @param entry FLASH_STATS_ index of the entry point. FLASH_STATS_INIT also
+        restarts the timer and drops a call that never returned.
+ */
+void flash_stats_begin(uint32_t entry);
+
+/** Finish accounting the call started by flash_stats_begin()
+    @param result value returned by the entry point
+    @return result
+ */
+uint32_t flash_stats_end(uint32_t result);
+
+/** Timer count, for measuring a busy wait with flash_stats_wait()
+    @return the count, 0 without a timer
+ */
+uint32_t flash_stats_now(void);
+
+/** Account the cycles from start to now as waiting on the flash controller
+    @param start flash_stats_now() before the wait
+ */
+void flash_stats_wait(uint32_t start);
+
+/** Keep the timer counting through a busy wait, in the body of every polling
+    loop. The SysTick count only extends past a 24 bit period if it is read
+    once per period, the other timers need nothing.
+ */
+#if FLASH_STATS_TIMER == FLASH_STATS_TIMER_SYSTICK
+#define flash_stats_poll()          ((void)flash_stats_now())
+#else
+#define flash_stats_poll()          ((void)0)
+#endif
+
+#if FLASH_STATS_TIMER == FLASH_STATS_TIMER_HOST
+/** Cycle counter of host builds, provided by the program */
+uint32_t flash_stats_host_cycles(void);
+#endif
+
+#ifdef __cplusplus
+  }
+#endif
+
+#endif
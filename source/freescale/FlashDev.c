@@ -15,21 +15,82 @@
  */
 
 #include "FlashOS.H"        // FlashOS Structures
+#include "fsl_device_registers.h"
 
-#define FLASH_DRV_VERS (0x0100+VERS)   // Driver Version, do not modify!
 #define DEVICE_NAME    "MKXX"
 
+// Program Flash geometry of the selected CPU, taken from its features header
+#define FLASH_PFLASH_SIZE        (FSL_FEATURE_FLASH_PFLASH_BLOCK_COUNT * FSL_FEATURE_FLASH_PFLASH_BLOCK_SIZE)
+#define FLASH_PFLASH_SECTOR_SIZE FSL_FEATURE_FLASH_PFLASH_BLOCK_SECTOR_SIZE
+
+// Page handed to ProgramPage; must be a whole number of write units and
+// must not span a sector boundary
+#define FLASH_PROGRAM_PAGE_SIZE  1024
+
+#if (FLASH_PROGRAM_PAGE_SIZE % FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE) || (FLASH_PFLASH_SECTOR_SIZE % FLASH_PROGRAM_PAGE_SIZE)
+    #error "Programming page size does not match the flash geometry"
+#endif
+
+// FlexNVM lies far behind PFlash, the addresses in between are not flash. A
+// version 1 sector table would stretch the PFlash sectors over the gap, so
+// FlexNVM is only described by the regions of FlashDeviceV2
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+#define FLASH_DFLASH_SIZE        (FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_COUNT * FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_SIZE)
+#define FLASH_DFLASH_SECTOR_SIZE FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_SECTOR_SIZE
+
+#if (FLASH_DFLASH_SECTOR_SIZE % FLASH_PROGRAM_PAGE_SIZE)
+    #error "Programming page size does not match the FlexNVM geometry"
+#endif
+
+#define FLASH_REGION_COUNT       2
+#else
+#define FLASH_REGION_COUNT       1
+#endif
+
+#define FLASH_DRV_VERS  (0x0100+VERS)   // Driver Version, do not modify!
+#define FLASH_DRV_VERS2 (0x0100+VERS2)  // Driver Version, do not modify!
+
+// Tools that only read version 1 descriptors, like the uVision flash download,
+// need this one
 struct FlashDevice const FlashDevice = {
     FLASH_DRV_VERS,             // Driver Version, do not modify!
     DEVICE_NAME,                // Device Name
     ONCHIP,                     // Device Type
     0x00000000,                 // Device Start Address
-    0x00000000,                 // Device Size
-    1024,                       // Programming Page Size
+    FLASH_PFLASH_SIZE,          // Device Size
+    FLASH_PROGRAM_PAGE_SIZE,    // Programming Page Size
     0,                          // Reserved, must be 0
     0xFF,                       // Initial Content of Erased Memory
     100,                        // Program Page Timeout 100 mSec
     3000,                       // Erase Sector Timeout 3000 mSec
-    {{0x000400, 0x000000},      // Sector Size  1kB
+    {{FLASH_PFLASH_SECTOR_SIZE, 0x000000},  // Sector Size from the features header
     {SECTOR_END}}
 };
+
+// Hosts that read the regions and capabilities, like the blobs of
+// generate_blobs.py, find this one. PFlash and FlexNVM are programmed in one pass
+FLASH_DEVICE_V2_STRUCT(FLASH_REGION_COUNT) const FlashDeviceV2 = {
+    {
+    FLASH_DRV_VERS2,            // Driver Version, do not modify!
+    DEVICE_NAME,                // Device Name
+    ONCHIP,                     // Device Type
+    0x00000000,                 // Device Start Address
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+    FSL_FEATURE_FLASH_FLEX_NVM_START_ADDRESS + FLASH_DFLASH_SIZE,  // Device Size, to the end of FlexNVM
+#else
+    FLASH_PFLASH_SIZE,          // Device Size
+#endif
+    FLASH_PROGRAM_PAGE_SIZE,    // Largest Programming Page Size
+    FLASH_CAP_BLANK_CHECK | FLASH_CAP_CRC | FLASH_CAP_MULTI_PAGE | FLASH_CAP_ASYNC_ERASE,
+    0xFF,                       // Initial Content of Erased Memory
+    100,                        // Program Page Timeout 100 mSec
+    3000,                       // Erase Sector Timeout 3000 mSec
+    FLASH_REGION_COUNT          // Number of Regions
+    },
+    {{0x00000000, FLASH_PFLASH_SIZE, FLASH_PFLASH_SECTOR_SIZE, FLASH_PROGRAM_PAGE_SIZE, 0xFF},  // PFlash
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+    {FSL_FEATURE_FLASH_FLEX_NVM_START_ADDRESS, FLASH_DFLASH_SIZE, FLASH_DFLASH_SECTOR_SIZE,
+     FLASH_PROGRAM_PAGE_SIZE, 0xFF},                                                            // FlexNVM
+#endif
+    }
+};
@@ -16,13 +16,37 @@
 
 #include "FlashOS.H"        // FlashOS Structures
 #include "flash.h"
+#include "crc32.h"
+#include "flash_diff.h"
+#include "flash_stats.h"
 #include "string.h"
 
+// Read margin used to verify programmed pages. Must be kFlashMargin_User or
+// kFlashMargin_Factory to catch weakly programmed bits. kFlashMargin_Normal only
+// compares through the memory map and runs PGMCHK on mismatching words; it is
+// faster but won't catch marginal cells, so projects must opt in to it.
+#ifndef FLASH_PROGRAM_VERIFY_MARGIN
+#define FLASH_PROGRAM_VERIFY_MARGIN kFlashMargin_User
+#endif
+
+// Read margin RD1SEC uses to decide that flash is already blank and the erase
+// can be skipped. A sector that only just reads as erased at the normal margin
+// would not be erased again, so this check is made at the user margin. The
+// checks after an erase stay at kFlashMargin_Normal.
+#ifndef FLASH_BLANK_SKIP_MARGIN
+#define FLASH_BLANK_SKIP_MARGIN kFlashMargin_User
+#endif
+
 // Storage for flash driver.
 flash_driver_t g_flash;
 
+// Sector erased by erase_sector_start(), verified when erase_poll() finds it done
+static uint32_t s_eraseAddress;
+static bool s_eraseVerify;
+
 int Init (unsigned long adr, unsigned long clk, unsigned long fnc)
 {
+    flash_stats_begin(FLASH_STATS_INIT);
 #if defined(KL28Z7_SERIES)
     WDOG0->CNT = WDOG_UPDATE_KEY;
     WDOG0->TOVAL = 0xFFFF;
@@ -38,7 +62,7 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc)
     SIM->COPC = 0x00u;
 #endif
 
-    return (flash_init(&g_flash) != kStatus_Success);
+    return flash_stats_end(flash_init(&g_flash) != kStatus_Success);
 }
 
 
@@ -49,7 +73,10 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc)
  */
 
 int UnInit (unsigned long fnc) {
-  return (0);
+  flash_stats_begin(FLASH_STATS_UNINIT);
+  // Leave a coherent cache behind for the application and the debugger
+  flash_cache_clear_if_dirty();
+  return flash_stats_end(0);
 }
 
 
@@ -60,35 +87,55 @@ int UnInit (unsigned long fnc) {
  *    Return Value:   0 - OK,  1 - Failed
  */
 
-// int BlankCheck (unsigned long adr, unsigned long sz, unsigned char pat)
-// {
-//     return (flash_verify_erase(&g_flash, adr, sz, kFlashMargin_Normal) != kStatus_Success);
-// }
-//
-// /*
-//  *  Verify Flash Contents
-//  *    Parameter:      adr:  Start Address
-//  *                    sz:   Size (in bytes)
-//  *                    buf:  Data
-//  *    Return Value:   (adr+sz) - OK, Failed Address
-//  */
-// unsigned long Verify (unsigned long adr, unsigned long sz, unsigned char *buf)
-// {
-//     uint32_t failedAddress;
-//     status_t status = flash_verify_program(&g_flash, adr, sz,
-//                               (const uint8_t *)buf, kFlashMargin_Normal,
-//                               &failedAddress, NULL);
-//
-//     if (status == kStatus_Success)
-//     {
-//         // Finished without Errors
-//         return (adr+sz);
-//     }
-//     else
-//     {
-//         return failedAddress;
-//     }
-// }
+int BlankCheck (unsigned long adr, unsigned long sz, unsigned char pat)
+{
+    flash_stats_begin(FLASH_STATS_BLANK_CHECK);
+
+    // Let RD1SEC check whole sections of erased (0xFF) flash, it doesn't need
+    // the data over the bus
+    if ((pat == 0xFF) && (((adr | sz) % FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT) == 0))
+    {
+        return flash_stats_end(flash_verify_erase(&g_flash, adr, sz, FLASH_BLANK_SKIP_MARGIN) != kStatus_Success);
+    }
+
+    // Unaligned ranges are compared through the memory map
+    flash_cache_clear_if_dirty();
+    const volatile uint8_t *data = (const volatile uint8_t *)FLASH_MAPPED_ADDRESS(adr);
+    while (sz--)
+    {
+        if (*data++ != pat)
+        {
+            return flash_stats_end(1);
+        }
+    }
+    return flash_stats_end(0);
+}
+
+/*
+ *  Verify Flash Contents
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes)
+ *                    buf:  Data
+ *    Return Value:   (adr+sz) - OK, Failed Address
+ */
+unsigned long Verify (unsigned long adr, unsigned long sz, unsigned char *buf)
+{
+    flash_stats_begin(FLASH_STATS_VERIFY);
+    uint32_t failedAddress = adr;
+    status_t status = flash_verify_program(&g_flash, adr, sz,
+                              (const uint8_t *)buf, kFlashMargin_Normal,
+                              &failedAddress, NULL);
+
+    if (status == kStatus_Success)
+    {
+        // Finished without Errors
+        return flash_stats_end(adr+sz);
+    }
+    else
+    {
+        return flash_stats_end(failedAddress);
+    }
+}
 
 /*
  *  Erase complete Flash Memory
@@ -97,13 +144,14 @@ int UnInit (unsigned long fnc) {
 
 int EraseChip (void)
 {
+    flash_stats_begin(FLASH_STATS_ERASE_CHIP);
     int status = flash_erase_all(&g_flash, kFlashEraseKey);
     if (status == kStatus_Success)
     {
+        flash_stats.bytes_erased += g_flash.PFlashTotalSize + g_flash.DFlashTotalSize;
         status = flash_verify_erase_all(&g_flash, kFlashMargin_Normal);
     }
-    flash_cache_clear();
-    return status;
+    return flash_stats_end(status);
 }
 
 
@@ -114,12 +162,115 @@ int EraseChip (void)
  */
 int EraseSector (unsigned long adr)
 {
-    int status = flash_erase(&g_flash, adr, g_flash.PFlashSectorSize, kFlashEraseKey);
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR);
+    uint32_t sectorSize = flash_get_sector_size(&g_flash, adr);
+
+    // Nothing to do if RD1SEC reports the sector is already blank
+    if (flash_verify_erase(&g_flash, adr, sectorSize, FLASH_BLANK_SKIP_MARGIN) == kStatus_Success)
+    {
+        return flash_stats_end(0);
+    }
+
+    int status = flash_erase(&g_flash, adr, sectorSize, kFlashEraseKey);
     if (status == kStatus_Success)
     {
-        status = flash_verify_erase(&g_flash, adr, g_flash.PFlashSectorSize, kFlashMargin_Normal);
+        flash_stats.bytes_erased += sectorSize;
+        status = flash_verify_erase(&g_flash, adr, sectorSize, kFlashMargin_Normal);
+    }
+    return flash_stats_end(status);
+}
+
+/*
+ *  Start erasing a Sector in Flash Memory
+ *    Parameter:      adr:  Sector Address
+ *    Return Value:   0 - Started,  otherwise an error code
+ */
+int erase_sector_start (unsigned long adr)
+{
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR_START);
+    uint32_t sectorSize = flash_get_sector_size(&g_flash, adr);
+
+    // Nothing to start if RD1SEC reports the sector is already blank, erase_poll
+    // then finds the controller idle
+    s_eraseAddress = adr;
+    s_eraseVerify = false;
+    if (flash_verify_erase(&g_flash, adr, sectorSize, FLASH_BLANK_SKIP_MARGIN) == kStatus_Success)
+    {
+        return flash_stats_end(0);
+    }
+
+    s_eraseVerify = true;
+    flash_stats.bytes_erased += sectorSize;
+    return flash_stats_end(flash_erase_sector_start(&g_flash, adr, kFlashEraseKey));
+}
+
+/*
+ *  Poll the Sector Erase started by erase_sector_start
+ *    Return Value:   0 - Done,  1 - Busy,  otherwise an error code
+ */
+int erase_poll (void)
+{
+    flash_stats_begin(FLASH_STATS_ERASE_POLL);
+    int status = flash_erase_poll(&g_flash);
+    if (status == kStatus_FlashBusy)
+    {
+        return flash_stats_end(1);
+    }
+    if ((status == kStatus_Success) && s_eraseVerify)
+    {
+        s_eraseVerify = false;
+        status = flash_verify_erase(&g_flash, s_eraseAddress, flash_get_sector_size(&g_flash, s_eraseAddress),
+                                    kFlashMargin_Normal);
+    }
+    return flash_stats_end(status);
+}
+
+/*
+ *  Erase Address Range in Flash Memory
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes)
+ *    Return Value:   0 - OK,  1 - Failed
+ */
+int erase_range (unsigned long adr, unsigned long sz)
+{
+    flash_stats_begin(FLASH_STATS_ERASE_RANGE);
+    uint32_t sectorSize = flash_get_sector_size(&g_flash, adr);
+    uint32_t start = ALIGN_DOWN(adr, sectorSize);
+    uint32_t length = ALIGN_UP(adr + sz, sectorSize) - start;
+
+    // Whole blocks in the range are erased with ERSBLK where available
+    int status = flash_erase(&g_flash, adr, sz, kFlashEraseKey);
+    if (status == kStatus_Success)
+    {
+        flash_stats.bytes_erased += length;
+        status = flash_verify_erase(&g_flash, start, length, kFlashMargin_Normal);
+    }
+    return flash_stats_end(status);
+}
+
+/*
+ *  Program and verify, failedAddress receives the first mismatching address
+ */
+static int program (uint32_t adr, uint32_t sz, uint8_t *buf, uint32_t *failedAddress)
+{
+    int status;
+#if FLASH_SUPPORTS_PROGRAM_SECTION
+    // Program the whole page from FlexRAM with a single PGMSEC command and
+    // fall back to unit programming when FlexRAM or the alignment don't allow it
+    status = flash_program_section(&g_flash, adr, (uint32_t *)buf, sz);
+    if ((status == kStatus_FlashFlexRamNotAvailable) || (status == kStatus_FlashAlignmentError))
+    {
+        status = flash_program(&g_flash, adr, (uint32_t *)buf, sz);
+    }
+#else
+    status = flash_program(&g_flash, adr, (uint32_t *)buf, sz);
+#endif
+    if (status == kStatus_Success)
+    {
+        status = flash_verify_program(&g_flash, adr, sz,
+                              (const uint8_t *)buf, FLASH_PROGRAM_VERIFY_MARGIN,
+                              failedAddress, NULL);
     }
-    flash_cache_clear();
     return status;
 }
 
@@ -132,15 +283,128 @@ int EraseSector (unsigned long adr)
  */
 int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf)
 {
-    int status = flash_program(&g_flash, adr, (uint32_t *)buf, sz);
-    if (status == kStatus_Success)
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGE);
+    return flash_stats_end(program(adr, sz, buf, NULL));
+}
+
+/*
+ *  Program Pages in Flash Memory
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes), any number of pages
+ *                    buf:  Data
+ *    Return Value:   (adr+sz) - OK, Failed Address
+ */
+unsigned long program_pages (unsigned long adr, unsigned long sz, unsigned char *buf)
+{
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGES);
+
+    // One sector at a time, so that a range never spans two flash blocks
+    while (sz)
     {
-        // Must use kFlashMargin_User, or kFlashMargin_Factory for verify program
-        status = flash_verify_program(&g_flash, adr, sz,
-                              (const uint8_t *)buf, kFlashMargin_User,
-                              NULL, NULL);
+        uint32_t sectorSize = flash_get_sector_size(&g_flash, adr);
+        uint32_t length = sectorSize - (adr % sectorSize);
+        uint32_t failedAddress = adr;
+        if (length > sz)
+        {
+            length = sz;
+        }
+        if (program(adr, length, buf, &failedAddress) != kStatus_Success)
+        {
+            return flash_stats_end(failedAddress);
+        }
+        adr += length;
+        buf += length;
+        sz -= length;
     }
-    flash_cache_clear();
-    return status;
+    return flash_stats_end(adr);
+}
+
+/*
+ *  Compute the CRC-32 of every sector in an address range
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes)
+ *                    crc:  One CRC per sector of the range
+ *    Return Value:   0 - OK,  1 - Failed
+ */
+int compute_crc (unsigned long adr, unsigned long sz, unsigned long *crc)
+{
+    flash_stats_begin(FLASH_STATS_COMPUTE_CRC);
+
+    // Sectors are read through the memory map
+    flash_cache_clear_if_dirty();
+    while (sz)
+    {
+        uint32_t sectorSize = flash_get_sector_size(&g_flash, adr);
+        uint32_t length = sectorSize - (adr % sectorSize);
+        if (length > sz)
+        {
+            length = sz;
+        }
+        *crc++ = crc32(0, (const void *)FLASH_MAPPED_ADDRESS(adr), length);
+        adr += length;
+        sz -= length;
+    }
+    return flash_stats_end(0);
 }
 
+/*
+ *  Program a Sector in Flash Memory if its Contents differ
+ *    Parameter:      adr:  Sector Start Address
+ *                    sz:   Size (in bytes), at most one sector. A sector that
+ *                          needs an erase is left alone unless it is blank past sz
+ *                    buf:  Sector Data
+ *    Return Value:   FLASH_ACTION_xxx bits of what was done
+ */
+unsigned long program_sector_if_changed (unsigned long adr, unsigned long sz, unsigned char *buf)
+{
+    flash_stats_begin(FLASH_STATS_PROGRAM_SECTOR_IF_CHANGED);
+    const uint32_t unit = FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE;
+    uint32_t sectorSize = flash_get_sector_size(&g_flash, adr);
+
+    if ((adr % sectorSize) || (sz > sectorSize) || (sz % unit))
+    {
+        return flash_stats_end(FLASH_ACTION_FAILED);
+    }
+
+    // A unit may only be programmed once between erases, so changes can only
+    // go into units that are still blank
+    flash_cache_clear_if_dirty();
+    uint32_t actions = flash_diff((const void *)FLASH_MAPPED_ADDRESS(adr), buf, sz, unit);
+    if (actions & FLASH_ACTION_ERASED)
+    {
+        // The erase would lose whatever the sector holds past sz
+        if ((sz < sectorSize) && BlankCheck(adr + sz, sectorSize - sz, 0xFF))
+        {
+            return flash_stats_end(FLASH_ACTION_FAILED);
+        }
+        if (flash_erase(&g_flash, adr, sectorSize, kFlashEraseKey) != kStatus_Success)
+        {
+            return flash_stats_end(actions | FLASH_ACTION_FAILED);
+        }
+        flash_stats.bytes_erased += sectorSize;
+        if (ProgramPage(adr, sz, buf) != kStatus_Success)
+        {
+            return flash_stats_end(actions | FLASH_ACTION_FAILED);
+        }
+    }
+    else if (actions & FLASH_ACTION_PROGRAMMED)
+    {
+        // Program each run of changed units
+        uint32_t offset = 0;
+        while (offset < sz)
+        {
+            uint32_t start = offset;
+            while ((offset < sz) &&
+                   memcmp((const void *)FLASH_MAPPED_ADDRESS(adr + offset), buf + offset, unit))
+            {
+                offset += unit;
+            }
+            if ((offset > start) && (ProgramPage(adr + start, offset - start, buf + start) != kStatus_Success))
+            {
+                return flash_stats_end(actions | FLASH_ACTION_FAILED);
+            }
+            offset += unit;
+        }
+    }
+    return flash_stats_end(actions);
+}
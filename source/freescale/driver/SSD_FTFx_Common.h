@@ -74,17 +74,31 @@
 #define FTFx_ERASE_ALL_BLOCK               0x44 //!< ERSALL
 #define FTFx_SECURITY_BY_PASS              0x45 //!< VFYKEY
 #define FTFx_ERASE_ALL_BLOCK_UNSECURE      0x49 //!< ERSALLU
+#define FTFx_SET_FLEXRAM_FUNCTION          0x81 //!< SETRAM
 //@}
 
 //! @brief Flash block base address
 #define FLASH_BLOCK_BASE                   0x00
 
+//! @brief FCCOB address of the start of FlexNVM
+#define FLASH_DFLASH_COMMAND_BASE          0x800000
+
+//! @brief Overlap the preparation of the next command with the running one.
+//!
+//! When set, flash_command_launch() returns as soon as the command has been started
+//! and the multi-command APIs (flash_program, flash_erase, flash_verify_erase) fetch
+//! and pack the operands of the next unit before calling flash_command_wait(). Set
+//! it to 0 to get the blocking behaviour for comparison. flash_erase_sector_start()
+//! uses flash_command_start() and never blocks.
+#if !defined(FLASH_COMMAND_PIPELINE)
+#define FLASH_COMMAND_PIPELINE             1
+#endif
+
 #if defined(FTFA)
     #define FTFx                           FTFA
     #define FTFx_BASE                      FTFA_BASE
 
-    #define FTFx_FSTAT_RD(x)               FTFA_FSTAT_REG(x)
-    #define FTFx_FSTAT_WR(x, v)            FTFA_FSTAT_REG(x) = (v)
+    #define FTFx_FSTAT_REG(x)              FTFA_FSTAT_REG(x)
 
     #define FTFx_FSTAT_CCIF_MASK           FTFA_FSTAT_CCIF_MASK
     #define FTFx_FSTAT_RDCOLERR_MASK       FTFA_FSTAT_RDCOLERR_MASK
@@ -92,6 +106,9 @@
     #define FTFx_FSTAT_FPVIOL_MASK         FTFA_FSTAT_FPVIOL_MASK
     #define FTFx_FSTAT_MGSTAT0_MASK        FTFA_FSTAT_MGSTAT0_MASK
 
+    #define FTFx_FCNFG_RD(x)               FTFA_FCNFG_REG(x)
+    #define FTFx_FCNFG_RAMRDY_MASK         FTFA_FCNFG_RAMRDY_MASK
+
     //#define FTFx_FCCOBx_WR(x, n, v)        FTFA_WR_FCCOB##n(x, v)
     #define FTFx_FCCOBx_WR(x, n, v)        FTFA_FCCOB##n##_REG(x) = (v)
 
@@ -102,8 +119,7 @@
     #define FTFx                           FTFE
     #define FTFx_BASE                      FTFE_BASE
 
-    #define FTFx_FSTAT_RD(x)               FTFE_FSTAT_REG(x)
-    #define FTFx_FSTAT_WR(x, v)            FTFE_FSTAT_REG(x) = (v)
+    #define FTFx_FSTAT_REG(x)              FTFE_FSTAT_REG(x)
 
     #define FTFx_FSTAT_CCIF_MASK           FTFE_FSTAT_CCIF_MASK
     #define FTFx_FSTAT_RDCOLERR_MASK       FTFE_FSTAT_RDCOLERR_MASK
@@ -111,6 +127,9 @@
     #define FTFx_FSTAT_FPVIOL_MASK         FTFE_FSTAT_FPVIOL_MASK
     #define FTFx_FSTAT_MGSTAT0_MASK        FTFE_FSTAT_MGSTAT0_MASK
 
+    #define FTFx_FCNFG_RD(x)               FTFE_FCNFG_REG(x)
+    #define FTFx_FCNFG_RAMRDY_MASK         FTFE_FCNFG_RAMRDY_MASK
+
     //#define FTFx_FCCOBx_WR(x, n, v)        FTFE_WR_FCCOB##n(x, v)
     #define FTFx_FCCOBx_WR(x, n, v)        FTFE_FCCOB##n##_REG(x) = (v)
 
@@ -121,8 +140,7 @@
     #define FTFx                           FTFL
     #define FTFx_BASE                      FTFL_BASE
 
-    #define FTFx_FSTAT_RD(x)               FTFL_FSTAT_REG(x)
-    #define FTFx_FSTAT_WR(x, v)            FTFL_FSTAT_REG(x) = (v)
+    #define FTFx_FSTAT_REG(x)              FTFL_FSTAT_REG(x)
 
     #define FTFx_FSTAT_CCIF_MASK           FTFL_FSTAT_CCIF_MASK
     #define FTFx_FSTAT_RDCOLERR_MASK       FTFL_FSTAT_RDCOLERR_MASK
@@ -130,6 +148,9 @@
     #define FTFx_FSTAT_FPVIOL_MASK         FTFL_FSTAT_FPVIOL_MASK
     #define FTFx_FSTAT_MGSTAT0_MASK        FTFL_FSTAT_MGSTAT0_MASK
 
+    #define FTFx_FCNFG_RD(x)               FTFL_FCNFG_REG(x)
+    #define FTFx_FCNFG_RAMRDY_MASK         FTFL_FCNFG_RAMRDY_MASK
+
     //#define FTFx_FCCOBx_WR(x, n, v)        FTFL_WR_FCCOB##n(x, v)
     #define FTFx_FCCOBx_WR(x, n, v)        FTFL_FCCOB##n##_REG(x) = (v)
 
@@ -140,6 +161,15 @@
     #error "Unknown flash controller"
 #endif
 
+//! @brief FSTAT accessors.
+//!
+//! Writing CCIF launches a command and reading FSTAT polls it, so a host build
+//! can provide its own accessors to run the driver against a model of the controller.
+#if !defined(FTFx_FSTAT_RD)
+    #define FTFx_FSTAT_RD(x)               FTFx_FSTAT_REG(x)
+    #define FTFx_FSTAT_WR(x, v)            FTFx_FSTAT_REG(x) = (v)
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // Externs
 ////////////////////////////////////////////////////////////////////////////////
@@ -165,6 +195,21 @@ void copy_flash_run_command(void);
 // Internal function Flash command sequence. Called by driver APIs only
 status_t flash_command_sequence(void);
 
+//! @brief Start the command loaded into FCCOB without waiting for it to complete.
+void flash_command_start(void);
+
+//! @brief Start the command loaded into FCCOB, completing it unless FLASH_COMMAND_PIPELINE is set.
+void flash_command_launch(void);
+
+//! @brief Wait for the command started by flash_command_launch() and return its status.
+status_t flash_command_wait(void);
+
+//! @brief Return kStatus_FlashBusy while the launched command runs, then its status.
+status_t flash_command_poll(void);
+
+//! @brief Returns the address to load into FCCOB for a memory mapped flash address.
+uint32_t flash_get_command_address(flash_driver_t * driver, uint32_t address);
+
 //! @brief Validates the range and alignment of the given address range.
 status_t flash_check_range(flash_driver_t * driver, uint32_t startAddress, uint32_t lengthInBytes, uint32_t alignmentBaseline);
 
@@ -64,7 +64,9 @@ enum _flash_status
     kStatus_FlashCommandFailure = MAKE_STATUS(kStatusGroup_FlashDriver, 5),
     kStatus_FlashUnknownProperty = MAKE_STATUS(kStatusGroup_FlashDriver, 6),
     kStatus_FlashEraseKeyError = MAKE_STATUS(kStatusGroup_FlashDriver, 7),
-    kStatus_FlashRegionExecuteOnly = MAKE_STATUS(kStatusGroup_FlashDriver, 8)
+    kStatus_FlashRegionExecuteOnly = MAKE_STATUS(kStatusGroup_FlashDriver, 8),
+    kStatus_FlashFlexRamNotAvailable = MAKE_STATUS(kStatusGroup_FlashDriver, 9),
+    kStatus_FlashBusy = MAKE_STATUS(kStatusGroup_FlashDriver, 10)
 };
 
 //! @brief Enumeration for flash driver API keys.
@@ -132,9 +134,35 @@ typedef struct _flash_driver {
     uint32_t PFlashAccessSegmentSize;   //!< Size in bytes of a access segment of PFlash.
     uint32_t PFlashAccessSegmentCount;  //!< Number of PFlash access segments.
     flash_callback_t PFlashCallback;    //!< Callback function for flash API.
+    uint32_t DFlashBlockBase;           //!< Base address of the FlexNVM block.
+    uint32_t DFlashTotalSize;           //!< Size of the FlexNVM partitioned as data flash, 0 if none.
+    uint32_t DFlashSectorSize;          //!< Size in bytes of a sector of data flash.
 } flash_driver_t;
 
 
+//! @brief Address used to access flash or FlexRAM through the memory map.
+//!
+//! Every memory-mapped access made by the driver goes through this macro so that
+//! a host build can redirect it to a model of the flash array.
+#if !defined(FLASH_MAPPED_ADDRESS)
+#define FLASH_MAPPED_ADDRESS(address) ((uintptr_t)(address))
+#endif
+
+//! @brief Invalidate the flash cache lazily.
+//!
+//! When set, the erase and program APIs only record that the flash contents have
+//! changed and the cache is invalidated by flash_cache_clear_if_dirty() before the
+//! next memory-mapped read. Set it to 0 to invalidate after every erase and program
+//! operation instead.
+#if !defined(FLASH_CACHE_CLEAR_LAZY)
+#define FLASH_CACHE_CLEAR_LAZY 1
+#endif
+
+//! @brief Whether the device can program a whole section from FlexRAM (PGMSEC).
+#define FLASH_SUPPORTS_PROGRAM_SECTION \
+    (FSL_FEATURE_FLASH_HAS_PROGRAM_SECTION_CMD && FSL_FEATURE_FLASH_HAS_FLEX_RAM)
+
+
 //! @brief Enumeration for the tow possible options of flash read resource command.
 typedef enum _flash_read_resource_option
 {
@@ -191,7 +219,9 @@ status_t flash_erase_all(flash_driver_t * driver, uint32_t key);
  * @brief Erases flash sectors encompassed by parameters passed into function
  *
  * This function erases the appropriate number of flash sectors based on the
- * desired start address and length.
+ * desired start address and length. On devices with the ERSBLK command, PFlash
+ * blocks that are entirely covered by the range are erased with a single command
+ * and only the unaligned edges are erased sector by sector.
  *
  * @param driver Pointer to storage for the driver runtime state.
  * @param start The start address of the desired flash memory to be erased.
@@ -204,6 +234,31 @@ status_t flash_erase_all(flash_driver_t * driver, uint32_t key);
  */
 status_t flash_erase(flash_driver_t * driver, uint32_t start, uint32_t lengthInBytes, uint32_t key);
 
+/*!
+ * @brief Starts erasing a flash sector without waiting for it to complete.
+ *
+ * No other flash command may be issued until flash_erase_poll() stops
+ * returning kStatus_FlashBusy. The erase runs in the background whatever
+ * FLASH_COMMAND_PIPELINE is set to.
+ *
+ * @param driver Pointer to storage for the driver runtime state.
+ * @param start An address within the sector to be erased. Must be word-aligned.
+ * @param key value used to validate all flash erase APIs.
+ *
+ * @return An error code or kStatus_Success once the erase has been started
+ */
+status_t flash_erase_sector_start(flash_driver_t * driver, uint32_t start, uint32_t key);
+
+/*!
+ * @brief Reports the progress of the erase started by flash_erase_sector_start().
+ *
+ * @param driver Pointer to storage for the driver runtime state.
+ *
+ * @return kStatus_FlashBusy while the sector is being erased, then an error
+ *         code or kStatus_Success
+ */
+status_t flash_erase_poll(flash_driver_t * driver);
+
 /*!
  * @brief Erases entire flash, including protected sectors.
  *
@@ -236,6 +291,31 @@ status_t flash_erase_all_unsecure(flash_driver_t * driver, uint32_t key);
  */
 status_t flash_program(flash_driver_t * driver, uint32_t start, uint32_t * src, uint32_t lengthInBytes);
 
+#if FLASH_SUPPORTS_PROGRAM_SECTION
+/*!
+ * @brief Programs flash with data at locations passed in through parameters
+ *        using the Program Section command
+ *
+ * The data is staged in FlexRAM and programmed with a single PGMSEC command per
+ * sector (or per section program buffer, if smaller), instead of one command per
+ * program unit as flash_program() does. FlexRAM is temporarily switched to RAM
+ * mode when it is in use as EEPROM backing store.
+ *
+ * @param driver Pointer to storage for the driver runtime state.
+ * @param start The start address of the desired flash memory to be programmed. Must be
+ *              aligned to FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT.
+ * @param src Pointer to the source buffer of data that is to be programmed
+ *        into the flash.
+ * @param lengthInBytes The length, given in bytes (not words or long-words)
+ *        to be programmed. Must be aligned to FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT.
+ *
+ * @return An error code or kStatus_Success. kStatus_FlashFlexRamNotAvailable is
+ *         returned when FlexRAM cannot be used as the section program buffer, in
+ *         which case the caller should fall back to flash_program().
+ */
+status_t flash_program_section(flash_driver_t * driver, uint32_t start, uint32_t * src, uint32_t lengthInBytes);
+#endif // FLASH_SUPPORTS_PROGRAM_SECTION
+
 /*!
  * @brief Programs Program Once Field through parameters
  *
@@ -375,14 +455,18 @@ status_t flash_verify_erase(flash_driver_t * driver, uint32_t start, uint32_t le
  * Flash Program Check Command and compares it with expected data for a given
  * flash area as determined by the start address and length.
  *
+ * With #kFlashMargin_Normal the flash is instead compared through the memory map
+ * after a single cache invalidate, and only mismatching words are checked again
+ * with a user margin Program Check Command.
+ *
  * @param driver Pointer to storage for the driver runtime state.
  * @param start The start address of the desired flash memory to be verified. Must be word-aligned.
  * @param lengthInBytes The length, given in bytes (not words or long-words)
  *        to be verified. Must be word-aligned.
  * @param expectedData Pointer to the expected data that is to be
  *        verified against.
- * @param margin Read margin choice as follows: kFlashMargin_User or
- *        kFlashMargin_Factory
+ * @param margin Read margin choice as follows: kFlashMargin_Normal,
+ *        kFlashMargin_User or kFlashMargin_Factory
  * @param failedAddress Pointer to returned failing address.
  * @param failedData Pointer to returned failing data.  Some derivitives do
  *        not included failed data as part of the FCCOBx registers.  In this
@@ -455,6 +539,23 @@ status_t flash_is_execute_only(flash_driver_t * driver, uint32_t start, uint32_t
  */
 status_t flash_get_property(flash_driver_t * driver, flash_property_t whichProperty, uint32_t * value);
 
+/*!
+ * @brief Returns true if the address is in the part of FlexNVM used as data flash.
+ */
+static inline bool flash_is_dflash_address(flash_driver_t * driver, uint32_t address)
+{
+    return (address >= driver->DFlashBlockBase)
+           && ((address - driver->DFlashBlockBase) < driver->DFlashTotalSize);
+}
+
+/*!
+ * @brief Returns the size of the sector containing the given address.
+ */
+static inline uint32_t flash_get_sector_size(flash_driver_t * driver, uint32_t address)
+{
+    return flash_is_dflash_address(driver, address) ? driver->DFlashSectorSize : driver->PFlashSectorSize;
+}
+
 //@}
 
 //! @name Cache
@@ -506,6 +607,44 @@ static inline void flash_cache_clear(void)
 #endif // FSL_FEATURE_FTFx_MCM_FLASH_CACHE_CONTROLS
 }
 
+#if FLASH_CACHE_CLEAR_LAZY
+//! @brief Set when flash has been modified since the cache was last invalidated.
+extern bool g_flashCacheDirty;
+#endif
+
+/*!
+ * @brief Record that the flash contents have been modified.
+ *
+ * Called by the erase and program APIs. With FLASH_CACHE_CLEAR_LAZY the cache is
+ * only marked as stale, otherwise it is invalidated right away.
+ */
+static inline void flash_cache_mark_dirty(void)
+{
+#if FLASH_CACHE_CLEAR_LAZY
+    g_flashCacheDirty = true;
+#else
+    flash_cache_clear();
+#endif
+}
+
+/*!
+ * @brief Invalidate the flash cache if flash was modified since the last invalidate.
+ *
+ * Must be called before flash contents are read through the memory map.
+ */
+static inline void flash_cache_clear_if_dirty(void)
+{
+#if FLASH_CACHE_CLEAR_LAZY
+    if (g_flashCacheDirty)
+    {
+        flash_cache_clear();
+        g_flashCacheDirty = false;
+    }
+#else
+    flash_cache_clear();
+#endif
+}
+
 //@}
 
 #if defined(__cplusplus)
@@ -33,6 +33,7 @@
 #include "flash.h"
 #include "fsl_device_registers.h"
 #include "fsl_platform_status.h"
+#include "flash_stats.h"
 #include "string.h"
 
 #if BL_TARGET_FLASH
@@ -87,18 +88,18 @@ void copy_flash_run_command(void)
 
 ////////////////////////////////////////////////////////////////////////////////
 //!
-//! @brief Flash Command Sequence
-//!
-//! This function is used to perform the command write sequence to the flash.
+//! @brief Start a flash command
 //!
-//! @param index Maximum index value of the command array.
-//! @param pCommandArray Pointer to the array which contains the data to be
-//!        written to the FCCOB registers.
+//! This function clears the error flags and CCIF to start the command that has
+//! been loaded into the FCCOB registers, and returns while the flash is still busy,
+//! whatever FLASH_COMMAND_PIPELINE is set to. FCCOB must not be written again
+//! until flash_command_wait() or flash_command_poll() report the command done.
 //!
-//! @return An error code or kStatus_Success
+//! A flash-resident bootloader cannot fetch code while the command runs, so it
+//! completes the command here.
 //!
 ////////////////////////////////////////////////////////////////////////////////
-status_t flash_command_sequence(void)
+void flash_command_start(void)
 {
     // clear RDCOLERR & ACCERR & FPVIOL flag in flash status register
     FTFx_FSTAT_WR(FTFx, FTFx_FSTAT_RDCOLERR_MASK | FTFx_FSTAT_ACCERR_MASK | FTFx_FSTAT_FPVIOL_MASK);
@@ -111,15 +112,79 @@ status_t flash_command_sequence(void)
 #else
     // clear CCIF bit
     FTFx_FSTAT_WR(FTFx, FTFx_FSTAT_CCIF_MASK);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! @brief Launch a flash command
+//!
+//! This function starts the command that has been loaded into the FCCOB registers
+//! with flash_command_start(). FCCOB must not be written again until
+//! flash_command_wait() has returned.
+//!
+//! With FLASH_COMMAND_PIPELINE set to 0 the command is completed here and
+//! flash_command_wait() only reports the result.
+//!
+////////////////////////////////////////////////////////////////////////////////
+void flash_command_launch(void)
+{
+    flash_command_start();
 
+#if !FLASH_COMMAND_PIPELINE && !BL_TARGET_FLASH
     // check CCIF bit of the flash status register, wait till it is set
-    while (!(FTFx_FSTAT_RD(FTFx) & FTFx_FSTAT_CCIF_MASK));
+    uint32_t start = flash_stats_now();
+    while (!(FTFx_FSTAT_RD(FTFx) & FTFx_FSTAT_CCIF_MASK))
+    {
+        flash_stats_poll();
+    }
+    flash_stats_wait(start);
 #endif
+}
 
-    // Check error bits
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! @brief Wait for a launched flash command
+//!
+//! This function waits for the command started by flash_command_launch() to
+//! complete and translates the error flags into a status code.
+//!
+//! @return An error code or kStatus_Success
+//!
+////////////////////////////////////////////////////////////////////////////////
+status_t flash_command_wait(void)
+{
+    // check CCIF bit of the flash status register, wait till it is set
+    uint32_t start = flash_stats_now();
+    while (!(FTFx_FSTAT_RD(FTFx) & FTFx_FSTAT_CCIF_MASK))
+    {
+        flash_stats_poll();
+    }
+    flash_stats_wait(start);
+
+    return flash_command_poll();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! @brief Poll a launched flash command
+//!
+//! This function reads FSTAT once and translates the error flags into a status
+//! code when the command started by flash_command_launch() has completed.
+//!
+//! @return kStatus_FlashBusy, an error code or kStatus_Success
+//!
+////////////////////////////////////////////////////////////////////////////////
+status_t flash_command_poll(void)
+{
     // Get flash status register value
-    uint8_t registerValue = FTFx->FSTAT;
+    uint8_t registerValue = FTFx_FSTAT_RD(FTFx);
 
+    // the command is still running until CCIF is set
+    if (!(registerValue & FTFx_FSTAT_CCIF_MASK))
+    {
+        return kStatus_FlashBusy;
+    }
     // checking access error
     if (registerValue & FTFx_FSTAT_ACCERR_MASK)
     {
@@ -138,6 +203,22 @@ status_t flash_command_sequence(void)
 
     return kStatus_Success;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//!
+//! @brief Flash Command Sequence
+//!
+//! This function is used to perform the command write sequence to the flash.
+//!
+//! @return An error code or kStatus_Success
+//!
+////////////////////////////////////////////////////////////////////////////////
+status_t flash_command_sequence(void)
+{
+    flash_command_launch();
+
+    return flash_command_wait();
+}
 ////////////////////////////////////////////////////////////////////////////////
 // EOF
 ////////////////////////////////////////////////////////////////////////////////
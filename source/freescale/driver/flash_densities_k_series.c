@@ -30,6 +30,7 @@
 
 #include "stdint.h"
 #include "flash_densities.h"
+#include "fsl_device_registers.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Variables
@@ -53,7 +54,11 @@ const uint16_t kFlashDensities[] = {
         0,      // 0xc - reserved
         256,    // 0xd - 1048576
         0,      // 0xe - reserved
+#if (FSL_FEATURE_FLASH_PFLASH_BLOCK_COUNT * FSL_FEATURE_FLASH_PFLASH_BLOCK_SIZE) == 2097152
+        512,    // 0xf - 2097152 on K65/K66
+#else
         256,    // 0xf - 1048576
+#endif
     };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -90,6 +90,23 @@ const uint16_t kFlashDensities[] = {
         0,  // 0xd - reserved
         0,  // 0xe - reserved
         64, // 0x0f - 262144, which is the maximum flash size supported by KL43
+#elif defined(KL28Z7_SERIES)
+        2,  // 0 - 8192
+        4,  // 1 - 16384
+        0,  // 2 - reserved
+        8,  // 3 - 32768
+        0,  // 4 - reserved
+        16, // 5 - 65536
+        0,  // 6 - reserved
+        32, // 7 - 131072
+        0,  // 8 - reserved
+        64, // 9 - 262144
+        0,  // 0xa - reserved
+        128, // 0xb - 524288
+        0,  // 0xc - reserved
+        0,  // 0xd - reserved
+        0,  // 0xe - reserved
+        128, // 0xf - 524288
 #else
         2,  // 0 - 8192
         4,  // 1 - 16384
@@ -56,28 +56,54 @@ status_t flash_erase(flash_driver_t * driver, uint32_t start, uint32_t lengthInB
 
     uint32_t endAddress;      // storing end address
     uint32_t numberOfSectors;  // number of sectors calculated by endAddress
+    uint32_t sectorSize = flash_get_sector_size(driver, start);
+
+#if FSL_FEATURE_FLASH_HAS_ERASE_FLASH_BLOCK_CMD
+    // the block fast path only applies to PFlash, FlexNVM may back EEPROM
+    uint32_t blockSize = driver->PFlashTotalSize / driver->PFlashBlockCount;
+    bool canEraseBlock = !flash_is_dflash_address(driver, start);
+#endif
+
+    // switch to the FCCOB address space of the region being erased
+    start = flash_get_command_address(driver, start);
 
     // calculating Flash end address
     endAddress = start + lengthInBytes - 1;
 
     // re-calculate the endAddress and align it to the start of the next sector
     // which will be used in the comparison below
-    if (endAddress % driver->PFlashSectorSize)
+    if (endAddress % sectorSize)
     {
-        numberOfSectors = endAddress / driver->PFlashSectorSize + 1;
-        endAddress = numberOfSectors * driver->PFlashSectorSize - 1;
+        numberOfSectors = endAddress / sectorSize + 1;
+        endAddress = numberOfSectors * sectorSize - 1;
     }
 
-    // the start address will increment to the next sector address
+    // the start address will increment to the next sector (or block) address
     // until it reaches the endAdddress
     while (start <= endAddress)
     {
-        // preparing passing parameter to erase a flash block
-        kFCCOBx[0] = start;
-        FTFx_FCCOBx_WR(FTFx, 0, FTFx_ERASE_SECTOR);
+        uint32_t eraseSize;
+
+#if FSL_FEATURE_FLASH_HAS_ERASE_FLASH_BLOCK_CMD
+        // erase whole blocks covered by the range with a single command
+        if (canEraseBlock && ((start % blockSize) == 0) && ((endAddress - start) >= (blockSize - 1)))
+        {
+            // preparing passing parameter to erase a flash block
+            kFCCOBx[0] = start;
+            FTFx_FCCOBx_WR(FTFx, 0, FTFx_ERASE_BLOCK);
+            eraseSize = blockSize;
+        }
+        else
+#endif
+        {
+            // preparing passing parameter to erase a flash sector
+            kFCCOBx[0] = start;
+            FTFx_FCCOBx_WR(FTFx, 0, FTFx_ERASE_SECTOR);
+            eraseSize = sectorSize;
+        }
 
-        // calling flash command sequence function to execute the command
-        returnCode = flash_command_sequence();
+        // start the command and let the callback run while the flash erases
+        flash_command_launch();
 
         // calling flash callback function if it is available
         if (driver->PFlashCallback)
@@ -86,20 +112,61 @@ status_t flash_erase(flash_driver_t * driver, uint32_t start, uint32_t lengthInB
         }
 
         // checking the success of command execution
+        returnCode = flash_command_wait();
         if (kStatus_Success != returnCode)
         {
             break;
         }
         else
         {
-            // Increment to the next sector
-            start += driver->PFlashSectorSize;
+            // Increment to the next sector or block
+            start = ALIGN_DOWN(start, sectorSize) + eraseSize;
         }
     }
 
+    flash_cache_mark_dirty();
+
     return(returnCode);
 }
 
+// See flash.h for documentation of this function.
+status_t flash_erase_sector_start(flash_driver_t * driver, uint32_t start, uint32_t key)
+{
+    // Validate the user key
+    status_t returnCode = flash_check_user_key(key);
+    if (returnCode)
+    {
+        return returnCode;
+    }
+
+    // Check the sector holding the address
+    uint32_t sectorSize = flash_get_sector_size(driver, start);
+    returnCode = flash_check_range(driver, ALIGN_DOWN(start, sectorSize), sectorSize,
+                                   FSL_FEATURE_FLASH_PFLASH_SECTOR_CMD_ADDRESS_ALIGMENT);
+    if (returnCode)
+    {
+        return returnCode;
+    }
+
+    // preparing passing parameter to erase a flash sector
+    kFCCOBx[0] = flash_get_command_address(driver, start);
+    FTFx_FCCOBx_WR(FTFx, 0, FTFx_ERASE_SECTOR);
+
+    // start the command and return while the flash erases, even when the
+    // multi-command APIs don't pipeline
+    flash_command_start();
+
+    flash_cache_mark_dirty();
+
+    return kStatus_Success;
+}
+
+// See flash.h for documentation of this function.
+status_t flash_erase_poll(flash_driver_t * driver)
+{
+    return flash_command_poll();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // EOF
 ////////////////////////////////////////////////////////////////////////////////
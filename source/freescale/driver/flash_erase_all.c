@@ -57,7 +57,11 @@ status_t flash_erase_all(flash_driver_t * driver, uint32_t key)
     FTFx_FCCOBx_WR(FTFx, 0, FTFx_ERASE_ALL_BLOCK);
 
     // calling flash command sequence function to execute the command
-    return flash_command_sequence();
+    returnCode = flash_command_sequence();
+
+    flash_cache_mark_dirty();
+
+    return returnCode;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
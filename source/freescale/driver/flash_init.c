@@ -43,6 +43,14 @@ enum
     kFlashAccessSegmentBase = 256UL,
 };
 
+// The driver issues the same commands with the same units on both regions
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+#if (FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_WRITE_UNIT_SIZE != FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE) \
+    || (FSL_FEATURE_FLASH_FLEX_NVM_SECTION_CMD_ADDRESS_ALIGMENT != FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT)
+    #error "Untreated FlexNVM command unit size"
+#endif
+#endif
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // Variables
@@ -50,6 +58,32 @@ enum
 
 volatile uint32_t * const restrict kFCCOBx = (volatile uint32_t *)&FTFx->FCCOB3;
 
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+//! @brief Data flash size for each value of SIM_FCFG1.DEPART.
+static const uint32_t kDFlashSizeForDepart[] = {
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0000,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0001,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0010,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0011,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0100,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0101,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0110,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0111,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1000,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1001,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1010,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1011,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1100,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1101,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1110,
+    FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1111
+};
+#endif // FSL_FEATURE_FLASH_HAS_FLEX_NVM
+
+#if FLASH_CACHE_CLEAR_LAZY
+bool g_flashCacheDirty = true;
+#endif
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -87,11 +121,26 @@ status_t flash_init(flash_driver_t * driver)
 
     driver->PFlashCallback = NULL;
 
+    // the part of FlexNVM not backing EEPROM is data flash, as set by SIM_FCFG1.DEPART
+    driver->DFlashBlockBase = FSL_FEATURE_FLASH_FLEX_NVM_START_ADDRESS;
+    driver->DFlashTotalSize = 0;
+    driver->DFlashSectorSize = FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_SECTOR_SIZE;
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+    uint32_t dflashSize = kDFlashSizeForDepart[(SIM_FCFG1_REG(SIM) & SIM_FCFG1_DEPART_MASK) >> SIM_FCFG1_DEPART_SHIFT];
+    if (dflashSize != 0xFFFFFFFFUL)
+    {
+        driver->DFlashTotalSize = dflashSize;
+    }
+#endif // FSL_FEATURE_FLASH_HAS_FLEX_NVM
+
     // copy flash_run_command() to RAM
 #if BL_TARGET_FLASH
     copy_flash_run_command();
 #endif
 
+    // nothing is known about what the cache holds yet
+    flash_cache_mark_dirty();
+
     return kStatus_Success;
 }
 
@@ -125,14 +174,33 @@ status_t flash_check_range(flash_driver_t * driver, uint32_t start, uint32_t len
         return kStatus_FlashAlignmentError;
     }
 
-    // check for valid range of the target addresses
-    if ((start < driver->PFlashBlockBase) ||
-        ((start+lengthInBytes) > (driver->PFlashBlockBase + driver->PFlashTotalSize)))
+    // check for valid range of the target addresses, which must be entirely
+    // within either PFlash or data flash
+    if ((start >= driver->PFlashBlockBase) &&
+        ((start+lengthInBytes) <= (driver->PFlashBlockBase + driver->PFlashTotalSize)))
     {
-        return kStatus_FlashAddressError;
+        return kStatus_Success;
     }
 
-    return kStatus_Success;
+    if ((driver->DFlashTotalSize != 0) && (start >= driver->DFlashBlockBase) &&
+        ((start+lengthInBytes) <= (driver->DFlashBlockBase + driver->DFlashTotalSize)))
+    {
+        return kStatus_Success;
+    }
+
+    return kStatus_FlashAddressError;
+}
+
+// See SSD_FTFx_Common.h for documentation of this function.
+uint32_t flash_get_command_address(flash_driver_t * driver, uint32_t address)
+{
+    // FlexNVM is addressed from FLASH_DFLASH_COMMAND_BASE in the FCCOB registers
+    if (flash_is_dflash_address(driver, address))
+    {
+        return address - driver->DFlashBlockBase + FLASH_DFLASH_COMMAND_BASE;
+    }
+
+    return address;
 }
 
 // See SSD_FTFx_Common.h for documentation of this function.
@@ -32,11 +32,22 @@
 #include "flash.h"
 #include "fsl_platform_status.h"
 #include "fsl_platform_types.h"
+#include "flash_diff.h"
+#include "flash_stats.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Declarations
 ////////////////////////////////////////////////////////////////////////////////
 
+//! @brief A program unit that holds the erased value and needs no command.
+#if !FLASH_PROGRAM_SKIP_ERASED
+#define UNIT_IS_ERASED(data0, data1)    (false)
+#elif (FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE == 8)
+#define UNIT_IS_ERASED(data0, data1)    (((data0) & (data1)) == FLASH_ERASED_WORD)
+#else
+#define UNIT_IS_ERASED(data0, data1)    ((data0) == FLASH_ERASED_WORD)
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // Code
 ////////////////////////////////////////////////////////////////////////////////
@@ -56,22 +67,61 @@ status_t flash_program(flash_driver_t * driver, uint32_t start, uint32_t * src,
         return returnCode;
     }
 
+    // switch to the FCCOB address space of the region being programmed
+    start = flash_get_command_address(driver, start);
+
+    // fetch the operands of the first program unit, src holds none for an
+    // empty range
+    uint32_t data0 = 0;
+#if (FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE == 8)
+    uint32_t data1 = 0;
+#endif
+    if (lengthInBytes > 0)
+    {
+        data0 = *src++;
+#if (FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE == 8)
+        data1 = *src++;
+#endif
+    }
+
     while (lengthInBytes > 0)
     {
-        // preparing passing parameter to program the flash block
-        kFCCOBx[0] = start;
-        kFCCOBx[1] = *src++;
+        // an erased unit already reads back as the data, leave it alone
+        bool launched = !UNIT_IS_ERASED(data0, data1);
+        if (launched)
+        {
+            // preparing passing parameter to program the flash block
+            kFCCOBx[0] = start;
+            kFCCOBx[1] = data0;
 #if (FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE == 4)
-        FTFx_FCCOBx_WR(FTFx, 0, FTFx_PROGRAM_LONGWORD);
+            FTFx_FCCOBx_WR(FTFx, 0, FTFx_PROGRAM_LONGWORD);
 #elif (FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE == 8)
-        kFCCOBx[2] = *src++;
-        FTFx_FCCOBx_WR(FTFx, 0, FTFx_PROGRAM_PHRASE);
+            kFCCOBx[2] = data1;
+            FTFx_FCCOBx_WR(FTFx, 0, FTFx_PROGRAM_PHRASE);
 #else
-        #error "Untreated program unit size"
+            #error "Untreated program unit size"
+#endif
+
+            // start the command, then get the next unit ready while it runs
+            flash_command_launch();
+        }
+
+        // update start address and lengthInBytes for next iteration
+        start += FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE;
+        lengthInBytes -= FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE;
+
+        if (lengthInBytes > 0)
+        {
+            data0 = *src++;
+#if (FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE == 8)
+            data1 = *src++;
 #endif
+        }
 
-        // calling flash command sequence function to execute the command
-        returnCode = flash_command_sequence();
+        if (!launched)
+        {
+            continue;
+        }
 
         // calling flash callback function if it is available
         if (driver->PFlashCallback)
@@ -80,20 +130,16 @@ status_t flash_program(flash_driver_t * driver, uint32_t start, uint32_t * src,
         }
 
         // checking for the success of command execution
+        returnCode = flash_command_wait();
         if (kStatus_Success != returnCode)
         {
             break;
         }
-        else
-        {
-            // update start address for next iteration
-            start += FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE;
-
-            // update lengthInBytes for next iteration
-            lengthInBytes -= FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE;
-        }
+        flash_stats.bytes_programmed += FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE;
     }
 
+    flash_cache_mark_dirty();
+
     return(returnCode);
 }
 ////////////////////////////////////////////////////////////////////////////////
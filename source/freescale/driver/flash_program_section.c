@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2013-2014, Freescale Semiconductor, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * o Redistributions of source code must retain the above copyright notice, this list
+ *   of conditions and the following disclaimer.
+ *
+ * o Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ *
+ * o Neither the name of Freescale Semiconductor, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SSD_FTFx_Common.h"
+#include "flash.h"
+#include "fsl_platform_status.h"
+#include "fsl_platform_types.h"
+#include "flash_diff.h"
+#include "flash_stats.h"
+
+#if FLASH_SUPPORTS_PROGRAM_SECTION
+
+////////////////////////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////////////////////////
+
+enum _flash_program_section_constants
+{
+    //! @brief Size of the section program buffer. Only the lower half of FlexRAM
+    //!        is guaranteed to be usable as the PGMSEC source on every FTFx variant.
+    kFlashSectionBufferSize = FSL_FEATURE_FLASH_FLEX_RAM_SIZE / 2,
+
+    //! @brief SETRAM control codes.
+    kFlashSetFlexRam_AvailableAsRam = 0xFF,
+    kFlashSetFlexRam_AvailableForEeprom = 0x00
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Prototypes
+////////////////////////////////////////////////////////////////////////////////
+
+static status_t flash_section_buffer_acquire(bool * restoreEeprom);
+static void flash_section_buffer_release(bool restoreEeprom);
+#if FLASH_PROGRAM_SKIP_ERASED
+static bool flash_section_unit_is_erased(const uint32_t * src);
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Code
+////////////////////////////////////////////////////////////////////////////////
+
+//! @brief Make sure FlexRAM is available as traditional RAM.
+//!
+//! If FlexRAM is currently configured as EEPROM backing store and the part supports
+//! the SETRAM command, it is temporarily switched to RAM mode and @a restoreEeprom is
+//! set so the caller can switch it back once programming has finished.
+static status_t flash_section_buffer_acquire(bool * restoreEeprom)
+{
+    *restoreEeprom = false;
+
+    if (FTFx_FCNFG_RD(FTFx) & FTFx_FCNFG_RAMRDY_MASK)
+    {
+        return kStatus_Success;
+    }
+
+#if FSL_FEATURE_FLASH_HAS_SET_FLEXRAM_FUNCTION_CMD
+    FTFx_FCCOBx_WR(FTFx, 0, FTFx_SET_FLEXRAM_FUNCTION);
+    FTFx_FCCOBx_WR(FTFx, 1, kFlashSetFlexRam_AvailableAsRam);
+
+    if ((flash_command_sequence() == kStatus_Success)
+        && (FTFx_FCNFG_RD(FTFx) & FTFx_FCNFG_RAMRDY_MASK))
+    {
+        *restoreEeprom = true;
+        return kStatus_Success;
+    }
+#endif // FSL_FEATURE_FLASH_HAS_SET_FLEXRAM_FUNCTION_CMD
+
+    return kStatus_FlashFlexRamNotAvailable;
+}
+
+//! @brief Give FlexRAM back to the EEPROM emulation if it was borrowed.
+static void flash_section_buffer_release(bool restoreEeprom)
+{
+#if FSL_FEATURE_FLASH_HAS_SET_FLEXRAM_FUNCTION_CMD
+    if (restoreEeprom)
+    {
+        FTFx_FCCOBx_WR(FTFx, 0, FTFx_SET_FLEXRAM_FUNCTION);
+        FTFx_FCCOBx_WR(FTFx, 1, kFlashSetFlexRam_AvailableForEeprom);
+        flash_command_sequence();
+    }
+#else
+    (void)restoreEeprom;
+#endif // FSL_FEATURE_FLASH_HAS_SET_FLEXRAM_FUNCTION_CMD
+}
+
+#if FLASH_PROGRAM_SKIP_ERASED
+//! @brief Check whether a section unit of the source holds only the erased value.
+static bool flash_section_unit_is_erased(const uint32_t * src)
+{
+    for (uint32_t i = 0; i < FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT / sizeof(uint32_t); i++)
+    {
+        if (src[i] != FLASH_ERASED_WORD)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+#endif // FLASH_PROGRAM_SKIP_ERASED
+
+// See flash.h for documentation of this function.
+status_t flash_program_section(flash_driver_t * driver, uint32_t start, uint32_t * src, uint32_t lengthInBytes)
+{
+    if (src == NULL)
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    // Check the supplied address range.
+    status_t returnCode = flash_check_range(driver, start, lengthInBytes, FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT);
+    if (returnCode)
+    {
+        return returnCode;
+    }
+
+    // switch to the FCCOB address space of the region being programmed
+    uint32_t sectorSize = flash_get_sector_size(driver, start);
+    start = flash_get_command_address(driver, start);
+
+    bool restoreEeprom;
+    returnCode = flash_section_buffer_acquire(&restoreEeprom);
+    if (returnCode)
+    {
+        return returnCode;
+    }
+
+    while (lengthInBytes > 0)
+    {
+#if FLASH_PROGRAM_SKIP_ERASED
+        // erased units ahead of the section already read back as the data
+        if (flash_section_unit_is_erased(src))
+        {
+            start += FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT;
+            src += FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT / sizeof(uint32_t);
+            lengthInBytes -= FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT;
+            continue;
+        }
+#endif // FLASH_PROGRAM_SKIP_ERASED
+
+        // A single section command must not cross a sector boundary nor exceed
+        // the section program buffer.
+        uint32_t sectionLength = ALIGN_UP(start + 1, sectorSize) - start;
+        if (sectionLength > kFlashSectionBufferSize)
+        {
+            sectionLength = kFlashSectionBufferSize;
+        }
+        if (sectionLength > lengthInBytes)
+        {
+            sectionLength = lengthInBytes;
+        }
+#if FLASH_PROGRAM_SKIP_ERASED
+        // and the ones at its end are skipped on the next iteration
+        while (flash_section_unit_is_erased(src + (sectionLength - FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT) / sizeof(uint32_t)))
+        {
+            sectionLength -= FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT;
+        }
+#endif // FLASH_PROGRAM_SKIP_ERASED
+
+        // stage the section in FlexRAM, which is the PGMSEC source buffer
+        volatile uint32_t * flexRam = (volatile uint32_t *)FLASH_MAPPED_ADDRESS(FSL_FEATURE_FLASH_FLEX_RAM_START_ADDRESS);
+        uint32_t wordCount = sectionLength / sizeof(uint32_t);
+        while (wordCount--)
+        {
+            *flexRam++ = *src++;
+        }
+
+        uint32_t numberOfUnits = sectionLength / FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT;
+
+        // preparing passing parameter to program the flash section
+        kFCCOBx[0] = start;
+        FTFx_FCCOBx_WR(FTFx, 0, FTFx_PROGRAM_SECTION);
+        FTFx_FCCOBx_WR(FTFx, 4, numberOfUnits >> 8);
+        FTFx_FCCOBx_WR(FTFx, 5, numberOfUnits & 0xFF);
+
+        // calling flash command sequence function to execute the command
+        returnCode = flash_command_sequence();
+
+        // calling flash callback function if it is available
+        if (driver->PFlashCallback)
+        {
+            driver->PFlashCallback();
+        }
+
+        // checking for the success of command execution
+        if (kStatus_Success != returnCode)
+        {
+            break;
+        }
+        flash_stats.bytes_programmed += sectionLength;
+
+        start += sectionLength;
+        lengthInBytes -= sectionLength;
+    }
+
+    flash_section_buffer_release(restoreEeprom);
+    flash_cache_mark_dirty();
+
+    return(returnCode);
+}
+
+#endif // FLASH_SUPPORTS_PROGRAM_SECTION
+
+////////////////////////////////////////////////////////////////////////////////
+// EOF
+////////////////////////////////////////////////////////////////////////////////
@@ -46,7 +46,18 @@ status_t flash_verify_erase(flash_driver_t * driver, uint32_t start, uint32_t le
         return returnCode;
     }
 
+    // a section command must not cross a PFlash or FlexNVM block boundary
     uint32_t blockSize = driver->PFlashTotalSize / driver->PFlashBlockCount;
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+    if (flash_is_dflash_address(driver, start))
+    {
+        blockSize = FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_SIZE;
+    }
+#endif // FSL_FEATURE_FLASH_HAS_FLEX_NVM
+
+    // switch to the FCCOB address space of the region being verified
+    start = flash_get_command_address(driver, start);
+
     uint32_t nextBlockStartAddress = ALIGN_UP(start, blockSize);
     if (nextBlockStartAddress == start)
     {
@@ -73,16 +84,18 @@ status_t flash_verify_erase(flash_driver_t * driver, uint32_t start, uint32_t le
         FTFx_FCCOBx_WR(FTFx, 5, numberOfPhrases & 0xFF);
         FTFx_FCCOBx_WR(FTFx, 6, margin);
 
-        // calling flash command sequence function to execute the command
-        returnCode = flash_command_sequence();
-        if (returnCode)
-        {
-            return returnCode;
-        }
+        // start the command and advance to the next block while it runs
+        flash_command_launch();
 
         remainingBytes -= verifyLength;
         start += verifyLength;
         nextBlockStartAddress += blockSize;
+
+        returnCode = flash_command_wait();
+        if (returnCode)
+        {
+            return returnCode;
+        }
     }
 
     return kStatus_Success;
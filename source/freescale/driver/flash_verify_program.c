@@ -34,55 +34,46 @@
 #include "fsl_platform_types.h"
 #include "fsl_device_registers.h"
 
+////////////////////////////////////////////////////////////////////////////////
+// Prototypes
+////////////////////////////////////////////////////////////////////////////////
+
+static status_t flash_program_check(flash_driver_t * driver, uint32_t start, uint32_t expectedWord, flash_margin_value_t margin,
+                                    uint32_t * failedAddress, uint8_t * failedData);
+static status_t flash_verify_program_mapped(flash_driver_t * driver, uint32_t start, uint32_t lengthInBytes, const uint8_t * expectedData,
+                                            uint32_t * failedAddress, uint8_t * failedData);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Code
 ////////////////////////////////////////////////////////////////////////////////
 
-// See flash.h for documentation of this function.
-status_t flash_verify_program(flash_driver_t * driver,
-                              uint32_t start,
-                              uint32_t lengthInBytes,
-                              const uint8_t * expectedData,
-                              flash_margin_value_t margin,
-                              uint32_t * failedAddress,
-                              uint8_t * failedData)
+//! @brief Run a single PGMCHK command on one check unit.
+static status_t flash_program_check(flash_driver_t * driver, uint32_t start, uint32_t expectedWord, flash_margin_value_t margin,
+                                    uint32_t * failedAddress, uint8_t * failedData)
 {
-    if (expectedData == NULL)
-    {
-        return kStatus_InvalidArgument;
-    }
+    // preparing passing parameter to program check the flash block
+    kFCCOBx[0] = flash_get_command_address(driver, start);
+    FTFx_FCCOBx_WR(FTFx, 0, FTFx_PROGRAM_CHECK);
+    FTFx_FCCOBx_WR(FTFx, 4, margin);
+    kFCCOBx[2] = expectedWord;
 
-    status_t returnCode = flash_check_range(driver, start, lengthInBytes, FSL_FEATURE_FLASH_PFLASH_CHECK_CMD_ADDRESS_ALIGMENT);
-    if (returnCode)
-    {
-        return returnCode;
-    }
+    // calling flash command sequence function to execute the command
+    status_t returnCode = flash_command_sequence();
 
-    while (lengthInBytes)
+    // checking for the success of command execution
+    if (kStatus_Success != returnCode)
     {
-        // preparing passing parameter to program check the flash block
-        kFCCOBx[0] = start;
-        FTFx_FCCOBx_WR(FTFx, 0, FTFx_PROGRAM_CHECK);
-        FTFx_FCCOBx_WR(FTFx, 4, margin);
-        kFCCOBx[2] = *(uint32_t *)expectedData;
-
-        // calling flash command sequence function to execute the command
-        returnCode = flash_command_sequence();
-
-        // checking for the success of command execution
-        if (kStatus_Success != returnCode)
+        if (failedAddress)
         {
-            if (failedAddress)
-            {
-                *failedAddress  =  start;
-            }
-            if (failedData)
-            {
-                *(uint32_t *)failedData = 0;
-            }
+            *failedAddress  =  start;
+        }
+        if (failedData)
+        {
+            *(uint32_t *)failedData = 0;
+        }
 
-        // Read fail returned data: if K70, Nevis2, L1PT, L2K are selected
-        //! @todo Use a feature macro to determine whether this is supported.
+    // Read fail returned data: if K70, Nevis2, L1PT, L2K are selected
+    //! @todo Use a feature macro to determine whether this is supported.
 // #if ((FTFx_KX_512K_512K_16K_4K_4K == FLASH_DERIVATIVE) || (FTFx_KX_1024K_0K_16K_4K_0K == FLASH_DERIVATIVE)\
 //         ||(FTFx_NX_256K_32K_2K_2K_1K == FLASH_DERIVATIVE)||(FTFx_NX_128K_32K_2K_2K_1K == FLASH_DERIVATIVE)\
 //         ||(FTFx_NX_96K_32K_2K_2K_1K == FLASH_DERIVATIVE)||(FTFx_NX_64K_32K_2K_2K_1K == FLASH_DERIVATIVE)\
@@ -106,7 +97,106 @@ status_t flash_verify_program(flash_driver_t * driver,
 //                 *(failedData)   = FTFA->FCCOB7;
 // #endif //of ENDIANNESS
 // #endif // of FLASH_DERIVATIVE
+    }
+
+    return returnCode;
+}
+
+//! @brief Compare flash contents through the memory map.
+//!
+//! The flash cache is invalidated if flash was modified since the last
+//! invalidate and the range is then compared a word at a time, four words per
+//! iteration. Only words that mismatch are escalated to a user margin PGMCHK,
+//! which either reports the failure or proves that the normal read was stale.
+static status_t flash_verify_program_mapped(flash_driver_t * driver, uint32_t start, uint32_t lengthInBytes, const uint8_t * expectedData,
+                                            uint32_t * failedAddress, uint8_t * failedData)
+{
+    flash_cache_clear_if_dirty();
+
+    const volatile uint32_t * flashData = (const volatile uint32_t *)FLASH_MAPPED_ADDRESS(start);
+    const uint32_t * expected = (const uint32_t *)expectedData;
+    uint32_t wordCount = lengthInBytes / sizeof(uint32_t);
+
+    while (wordCount)
+    {
+        if ((wordCount >= 4)
+            && (flashData[0] == expected[0])
+            && (flashData[1] == expected[1])
+            && (flashData[2] == expected[2])
+            && (flashData[3] == expected[3]))
+        {
+            flashData += 4;
+            expected += 4;
+            wordCount -= 4;
+            continue;
+        }
+
+        if (*flashData != *expected)
+        {
+            uint32_t address = start + (lengthInBytes - wordCount * sizeof(uint32_t));
+            status_t returnCode = flash_program_check(driver, address, *expected, kFlashMargin_User,
+                                                      failedAddress, failedData);
+            if (kStatus_Success != returnCode)
+            {
+                return returnCode;
+            }
+
+            // The margin check passed, so re-read the word once the cache is clean.
+            flash_cache_clear();
+            if (*flashData != *expected)
+            {
+                if (failedAddress)
+                {
+                    *failedAddress = address;
+                }
+                if (failedData)
+                {
+                    *(uint32_t *)failedData = *flashData;
+                }
+                return kStatus_FlashCommandFailure;
+            }
+        }
+
+        flashData++;
+        expected++;
+        wordCount--;
+    }
 
+    return kStatus_Success;
+}
+
+// See flash.h for documentation of this function.
+status_t flash_verify_program(flash_driver_t * driver,
+                              uint32_t start,
+                              uint32_t lengthInBytes,
+                              const uint8_t * expectedData,
+                              flash_margin_value_t margin,
+                              uint32_t * failedAddress,
+                              uint8_t * failedData)
+{
+    if (expectedData == NULL)
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    status_t returnCode = flash_check_range(driver, start, lengthInBytes, FSL_FEATURE_FLASH_PFLASH_CHECK_CMD_ADDRESS_ALIGMENT);
+    if (returnCode)
+    {
+        return returnCode;
+    }
+
+    // PGMCHK only accepts the user and factory margins; a normal read is a
+    // plain memory-mapped compare.
+    if (margin == kFlashMargin_Normal)
+    {
+        return flash_verify_program_mapped(driver, start, lengthInBytes, expectedData, failedAddress, failedData);
+    }
+
+    while (lengthInBytes)
+    {
+        returnCode = flash_program_check(driver, start, *(uint32_t *)expectedData, margin, failedAddress, failedData);
+        if (kStatus_Success != returnCode)
+        {
             break;
         }
 
@@ -121,4 +211,3 @@ status_t flash_verify_program(flash_driver_t * driver,
 ////////////////////////////////////////////////////////////////////////////////
 // EOF
 ////////////////////////////////////////////////////////////////////////////////
-
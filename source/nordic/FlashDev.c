@@ -16,21 +16,52 @@
 
 #include "FlashOS.H"
 
-#define FLASH_DRV_VERS (0x0100+VERS)   // Driver Version, do not modify!
 #define DEVICE_NAME    "nRF51822AA 256 KB Flash"
 
+#define FLASH_DRV_VERS  (0x0100+VERS)   // Driver Version, do not modify!
+#define FLASH_DRV_VERS2 (0x0100+VERS2)  // Driver Version, do not modify!
+
+//
+// Tools that only read version 1 descriptors, like the uVision flash download,
+// need this one. The sector table can't describe the UICR beyond the CODE region.
+// It describes the largest CODE of the family, the algorithm checks addresses
+// against the FICR of the part
+//
 struct FlashDevice const FlashDevice  =  {
     FLASH_DRV_VERS,             // Driver Version, do not modify!
     DEVICE_NAME,                // Device Name
     ONCHIP,                     // Device Type
     0x00000000,                 // Flash start address
-    0x00040000,                 // Flash total size (256 KB // + 1 kB)
-    4,                          // Programming Page Size
+    0x00040000,                 // Flash total size (256 KB)
+    1024,                       // Programming Page Size, a 1 KB code page
     0,                          // Reserved, must be 0
     0xFF,                       // Initial Content of Erased Memory
     100,                        // Program Page Timeout 100 mSec
     3000,                       // Erase Sector Timeout 3000 mSec
     {{0x000400, 0x000000},      // Sector Size  1 KB (256 Sectors)
-//    {0x000400, 0x10001000},     // Sector Size  1 KB (1 Sector)
     {SECTOR_END}}               // Marks end of sector table
 };
+
+//
+// Hosts that read the regions and capabilities, like the blobs of
+// generate_blobs.py, find this one with the UICR. CODE is the largest of the
+// family, get_geometry reports what the part has
+//
+FLASH_DEVICE_V2_STRUCT(2) const FlashDeviceV2  =  {
+    {
+    FLASH_DRV_VERS2,            // Driver Version, do not modify!
+    DEVICE_NAME,                // Device Name
+    ONCHIP,                     // Device Type
+    0x00000000,                 // Flash start address
+    0x00040000,                 // Flash total size (256 KB)
+    1024,                       // Largest Programming Page Size
+    FLASH_CAP_BLANK_CHECK | FLASH_CAP_CRC | FLASH_CAP_MULTI_PAGE |
+    FLASH_CAP_ASYNC_ERASE | FLASH_CAP_GEOMETRY,
+    0xFF,                       // Initial Content of Erased Memory
+    100,                        // Program Page Timeout 100 mSec
+    3000,                       // Erase Sector Timeout 3000 mSec
+    2                           // Number of Regions
+    },
+    {{0x00000000, 0x00040000, 0x000400, 0x000400, 0xFF},   // CODE, 1 KB pages (256 Sectors)
+    {0x10001000, 0x00000100, 0x000100, 0x000100, 0xFF}}    // UICR, erased as a whole
+};
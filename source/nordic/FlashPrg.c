@@ -15,6 +15,9 @@
  */
 
 #include "FlashOS.H"
+#include "crc32.h"
+#include "flash_diff.h"
+#include "flash_stats.h"
 
 #define U8  unsigned char
 #define U16 unsigned short
@@ -36,6 +39,17 @@
 #define FLASH_REG_BASE_ADDR (0x4001E000)
 #define INFO_REGS_BASE_ADDR (0x10000000)
 #define WDT_REGS_BASE_ADDR  (0x40010000)
+#define UICR_BASE           (0x10001000)
+#define UICR_SIZE           (0x100)       // UICR registers, erased as a whole
+#define COMPARE_CHUNK       (0x400)       // Bytes compared between watchdog feeds
+
+//
+// EraseSector and erase_sector_start leave sectors that read back blank alone.
+// Reading a page takes a fraction of the ~22 ms erase, set to 0 to always erase
+//
+#ifndef ERASE_SKIP_BLANK
+#define ERASE_SKIP_BLANK    1
+#endif
 
 #define FLASH_REG_READY       *((volatile U32*)(FLASH_REG_BASE_ADDR + 0x400))
 #define FLASH_REG_CONFIG      *((volatile U32*)(FLASH_REG_BASE_ADDR + 0x504))
@@ -50,12 +64,30 @@
 
 #define WDT_REG_INTENSET      *((volatile U32*)(WDT_REGS_BASE_ADDR + 0x304))
 #define WDT_REG_INTENCLR      *((volatile U32*)(WDT_REGS_BASE_ADDR + 0x308))
+#define WDT_REG_RUNSTATUS     *((volatile U32*)(WDT_REGS_BASE_ADDR + 0x400))
 #define WDT_REG_REQSTATUS     *((volatile U32*)(WDT_REGS_BASE_ADDR + 0x404))
 #define WDT_REG_CRV           *((volatile U32*)(WDT_REGS_BASE_ADDR + 0x504))
 #define WDT_REG_RREN          *((volatile U32*)(WDT_REGS_BASE_ADDR + 0x508))
 #define WDT_REG_CONFIG        *((volatile U32*)(WDT_REGS_BASE_ADDR + 0x50C))
 #define WDT_REG_RR0           *((volatile U32*)(WDT_REGS_BASE_ADDR + 0x600))  // 8 registers, each 4 bytes in size
 
+//
+// READY polls per tick of the 32.768 kHz watchdog clock. A poll takes far
+// less than the 122 cycles of 16 MHz this allows for
+//
+#define WDT_POLLS_PER_TICK    (4)
+
+//
+// Code pages of the part. They start out as the 256 KB of 1 KB pages FlashDev.c
+// describes, so that no entry point divides by zero when a host skips Init.
+// Init replaces them with FICR CODEPAGESIZE and CODESIZE, which are smaller on
+// the 128 KB parts of the family
+//
+static U32 _PageSize = 0x400;
+static U32 _NumPages = 0x100;
+static U32 _FeedInterval;   // READY polls between watchdog feeds, set up by Init
+static U32 _PollsLeft;      // READY polls until the next feed
+
 /*
  *  Feed watchdog, if running
  */
@@ -80,12 +112,86 @@ static void _FeedWDT(void)
     }
 }
 
+/*
+ *  Work out the READY polls after which the watchdog is fed, half of its
+ *  timeout. A running watchdog can't be reconfigured, so CRV is read once
+ */
+static void _StartWDTSchedule(void)
+{
+    U32 Crv;
+
+    _FeedInterval = 0xFFFFFFFF;
+    if (WDT_REG_RUNSTATUS & 1) {
+        Crv = WDT_REG_CRV;
+        if (Crv < 0xFFFFFFFF / (WDT_POLLS_PER_TICK / 2)) {
+            _FeedInterval = (Crv + 1) * (WDT_POLLS_PER_TICK / 2);
+        }
+    }
+    _PollsLeft = _FeedInterval;
+}
+
+/*
+ *  Count a READY poll, feeding the watchdog when the interval is used up
+ */
+static void _PollWDT(void)
+{
+    if (--_PollsLeft == 0) {
+        _PollsLeft = _FeedInterval;
+        _FeedWDT();
+    }
+}
+
+/*
+ *  Wait for the flash controller to become ready, feeding the watchdog
+ */
+static void _WaitReady(void)
+{
+    U32 Start;
+
+    Start = flash_stats_now();
+    while ((FLASH_REG_READY & 1) == 0) {   // Flash controller busy?
+        _PollWDT();
+        flash_stats_poll();
+    }
+    flash_stats_wait(Start);
+}
+
+/*
+ *  Wait for a word write to complete, ~50 us. The caller accounts the wait
+ *  for a whole page of words
+ */
+static void _WaitWordReady(void)
+{
+    while ((FLASH_REG_READY & 1) == 0) {
+        _PollWDT();
+        flash_stats_poll();
+    }
+}
+
+/*
+ *  Size of the CODE page or UICR erased at Addr
+ */
+static U32 _SectorSize(U32 Addr)
+{
+    return (Addr >= UICR_BASE) ? UICR_SIZE : _PageSize;
+}
+
+/*
+ *  Check that Addr is in a CODE page the part has or in the UICR
+ */
+static int _IsSector(U32 Addr)
+{
+    if (Addr >= UICR_BASE) {
+        return Addr < UICR_BASE + UICR_SIZE;
+    }
+    return (Addr / _PageSize) < _NumPages;
+}
+
 /*
  *  Erase a single flash sector
  */
 static void _EraseSector(U32 Addr)
 {
-    U32 Status;
     //
     // Make sure that flash controller is in erase mode
     //
@@ -93,7 +199,7 @@ static void _EraseSector(U32 Addr)
     //
     // Check if sector is the UICR or CODE region
     //
-    if (Addr >= 0x10001000) {
+    if (Addr >= UICR_BASE) {
         FLASH_REG_ERASEUICR = 1;
     } else {
         FLASH_REG_ERASEPAGE = Addr;
@@ -101,17 +207,96 @@ static void _EraseSector(U32 Addr)
     //
     // Wait for operation to complete
     //
-    do {
-        _FeedWDT();
-        Status = FLASH_REG_READY;
-        if (Status & 1) {        // Flash controller ready?
-          break;
-        }
-    } while(1);
+    _WaitReady();
     //
     // Bring back flash controller into read mode
     //
     FLASH_REG_CONFIG = FLASH_MODE_READ;
+    flash_stats.bytes_erased += _SectorSize(Addr);
+}
+
+/*
+ *  Compare flash with data, four words per branch
+ *    Parameter:      Addr:     Start Address
+ *                    NumBytes: Size (in bytes)
+ *                    pData:    Data, or a single word of a pattern
+ *                    Step:     1 to step through the data, 0 for a pattern
+ *    Return Value:   Address of the first byte that differs, Addr+NumBytes if none
+ */
+static U32 _Compare(U32 Addr, U32 NumBytes, const U32* pData, U32 Step)
+{
+    const U32* pFlash;
+    const U8* pFlashByte;
+    const U8* pDataByte;
+    U32 Diff;
+
+    pFlash = (const U32*)Addr;
+    if (((Addr | (U32)pData) & 3) == 0) {
+        while (NumBytes >= 16) {
+            Diff  = pFlash[0] ^ pData[0];
+            Diff |= pFlash[1] ^ pData[Step];
+            Diff |= pFlash[2] ^ pData[2 * Step];
+            Diff |= pFlash[3] ^ pData[3 * Step];
+            if (Diff) {
+                break;
+            }
+            pFlash += 4;
+            pData += 4 * Step;
+            NumBytes -= 16;
+        }
+        while ((NumBytes >= 4) && (*pFlash == *pData)) {
+            pFlash++;
+            pData += Step;
+            NumBytes -= 4;
+        }
+    }
+    //
+    // The word that differs, unaligned ranges and the tail byte by byte
+    //
+    pFlashByte = (const U8*)pFlash;
+    pDataByte = (const U8*)pData;
+    while (NumBytes && (*pFlashByte == *pDataByte)) {
+        pFlashByte++;
+        pDataByte += Step;
+        NumBytes--;
+    }
+    return (U32)pFlashByte;
+}
+
+/*
+ *  Compare a range of flash with data a chunk at a time, feeding the watchdog
+ *    Return Value:   Address of the first byte that differs, Addr+NumBytes if none
+ */
+static U32 _CompareRange(U32 Addr, U32 NumBytes, const U32* pData, U32 Step)
+{
+    U32 Chunk;
+    U32 Failed;
+
+    while (NumBytes) {
+        Chunk = (NumBytes < COMPARE_CHUNK) ? NumBytes : COMPARE_CHUNK;
+        Failed = _Compare(Addr, Chunk, pData, Step);
+        if (Failed != Addr + Chunk) {
+            return Failed;
+        }
+        Addr += Chunk;
+        pData += (Chunk >> 2) * Step;
+        NumBytes -= Chunk;
+        _FeedWDT();
+    }
+    return Addr;
+}
+
+/*
+ *  Check whether the sector at Addr reads back erased
+ */
+static int _IsBlank(U32 Addr)
+{
+    U32 Pattern;
+    U32 Size;
+
+    Pattern = FLASH_ERASED_WORD;
+    Size = _SectorSize(Addr);
+    return _CompareRange(Addr, Size, &Pattern, 0) == Addr + Size;
 }
 
 /*
@@ -123,10 +308,14 @@ static void _EraseSector(U32 Addr)
  */
 int Init (unsigned long adr, unsigned long clk, unsigned long fnc)
 {
+    flash_stats_begin(FLASH_STATS_INIT);
     //
-    // No special init necessary
+    // The same algorithm serves every CODE size of the family
     //
-    return (0);
+    _PageSize = INFO_REG_CODEPAGESIZE;
+    _NumPages = INFO_REG_CODESIZE;
+    _StartWDTSchedule();
+    return flash_stats_end(0);
 }
 
 /*
@@ -137,10 +326,53 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc)
 
 int UnInit (unsigned long fnc)
 {
+    flash_stats_begin(FLASH_STATS_UNINIT);
     //
     // No special uninit necessary
     //
-    return (0);
+    return flash_stats_end(0);
+}
+
+/*
+ *  Blank Check Block in Flash Memory
+ *    Parameter:      adr:  Block Start Address
+ *                    sz:   Block Size (in bytes)
+ *                    pat:  Block Pattern
+ *    Return Value:   0 - OK,  1 - Failed
+ */
+int BlankCheck (unsigned long adr, unsigned long sz, unsigned char pat)
+{
+    U32 Pattern;
+
+    flash_stats_begin(FLASH_STATS_BLANK_CHECK);
+    Pattern = pat * 0x01010101;
+    return flash_stats_end(_CompareRange(adr, sz, &Pattern, 0) != adr + sz);
+}
+
+/*
+ *  Verify Flash Contents
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes)
+ *                    buf:  Data
+ *    Return Value:   (adr+sz) - OK, Failed Address
+ */
+unsigned long Verify (unsigned long adr, unsigned long sz, unsigned char *buf)
+{
+    flash_stats_begin(FLASH_STATS_VERIFY);
+    return flash_stats_end(_CompareRange(adr, sz, (const U32*)buf, 1));
+}
+
+/*
+ *  Get the Flash Geometry of the Part, read from FICR by Init
+ *    Parameter:      geometry: Page Size and Number of Pages of the CODE region
+ *    Return Value:   0 - OK
+ */
+int get_geometry (struct FlashGeometry *geometry)
+{
+    flash_stats_begin(FLASH_STATS_GET_GEOMETRY);
+    geometry->szPage = _PageSize;
+    geometry->numPages = _NumPages;
+    return flash_stats_end(0);
 }
 
 /*
@@ -149,7 +381,7 @@ int UnInit (unsigned long fnc)
  */
 int EraseChip (void)
 {
-    U32 Status;
+    flash_stats_begin(FLASH_STATS_ERASE_CHIP);
     //
     // Make sure that flash controller is in erase mode
     //
@@ -164,18 +396,13 @@ int EraseChip (void)
     //
     // Wait for operation to complete
     //
-    do {
-		    Status = FLASH_REG_READY;
-		    if (Status & 1) {        // Flash controller ready?
-            break;
-		    }
-		    _FeedWDT();
-    } while(1);
+    _WaitReady();
     //
     // Bring back flash controller into read mode
     //
     FLASH_REG_CONFIG = FLASH_MODE_READ;   
-    return (0);                                    // Finished without Errors
+    flash_stats.bytes_erased += _NumPages * _PageSize + UICR_SIZE;
+    return flash_stats_end(0);                     // Finished without Errors
 }
 
 /*
@@ -185,8 +412,68 @@ int EraseChip (void)
  */
 int EraseSector (unsigned long adr)
 {
-    _EraseSector(adr);
-    return (0);
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR);
+    //
+    // Smaller parts of the family don't have all the pages of FlashDevice
+    //
+    if (!_IsSector(adr)) {
+        return flash_stats_end(1);
+    }
+    if (!ERASE_SKIP_BLANK || !_IsBlank(adr)) {
+        _EraseSector(adr);
+    }
+    return flash_stats_end(0);
+}
+
+/*
+ *  Start erasing a Sector in Flash Memory
+ *    Parameter:      adr:  Sector Address
+ *    Return Value:   0 - Started,  1 - Failed
+ */
+int erase_sector_start (unsigned long adr)
+{
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR_START);
+    if (!_IsSector(adr)) {
+        return flash_stats_end(1);
+    }
+    //
+    // Nothing to start for a blank sector, erase_poll then finds the controller ready
+    //
+    if (ERASE_SKIP_BLANK && _IsBlank(adr)) {
+        return flash_stats_end(0);
+    }
+    //
+    // Make sure that flash controller is in erase mode
+    //
+    FLASH_REG_CONFIG = FLASH_MODE_ERASE;
+    //
+    // Check if sector is the UICR or CODE region
+    //
+    if (adr >= UICR_BASE) {
+        FLASH_REG_ERASEUICR = 1;
+    } else {
+        FLASH_REG_ERASEPAGE = adr;
+    }
+    flash_stats.bytes_erased += _SectorSize(adr);
+    return flash_stats_end(0);
+}
+
+/*
+ *  Poll the Sector Erase started by erase_sector_start
+ *    Return Value:   0 - Done,  1 - Busy
+ */
+int erase_poll (void)
+{
+    flash_stats_begin(FLASH_STATS_ERASE_POLL);
+    _FeedWDT();
+    if ((FLASH_REG_READY & 1) == 0) {   // Flash controller still busy?
+        return flash_stats_end(1);
+    }
+    //
+    // Bring back flash controller into read mode
+    //
+    FLASH_REG_CONFIG = FLASH_MODE_READ;
+    return flash_stats_end(0);
 }
 
 /*
@@ -201,38 +488,177 @@ int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf)
     volatile U32* pDest;
     volatile U32* pSrc;
     U32 NumWords;
-    U32 Status;
-	
+    U32 Start;
+
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGE);
     pDest = (volatile U32*)adr;
     pSrc = (volatile U32*)buf;    // Always 32-bit aligned. Made sure by CMSIS-DAP firmware
     //
     // adr is always aligned to "Programming Page Size" specified in table in FlashDev.c
-    // sz is always a multiple of "Programming Page Size"
+    // sz is at most one page and a multiple of 4
     //
-    NumWords = sz >> 2;	
+    NumWords = sz >> 2;
+    Start = flash_stats_now();
     //
     // Make sure that flash controller is in write mode
     //
     FLASH_REG_CONFIG = FLASH_MODE_WRITE;
     //
-    // Program word by word
+    // Program word by word, erased words already read back as the data
+    //
+    while (NumWords--) {
+        if (!FLASH_PROGRAM_SKIP_ERASED || (*pSrc != FLASH_ERASED_WORD)) {
+            *pDest = *pSrc;
+            _WaitWordReady();
+            flash_stats.bytes_programmed += 4;
+        }
+        pDest++;
+        pSrc++;
+    }
+    //
+    // Bring back flash controller into read mode
     //
-    do {
-        *pDest++ = *pSrc++;
+    FLASH_REG_CONFIG = FLASH_MODE_READ;
+    flash_stats_wait(Start);
+    return flash_stats_end(0);                   // Finished without Errors
+}
+
+/*
+ *  Program Pages in Flash Memory
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes), any number of pages
+ *                    buf:  Data
+ *    Return Value:   (adr+sz) - OK, Failed Address
+ */
+unsigned long program_pages (unsigned long adr, unsigned long sz, unsigned char *buf)
+{
+    volatile U32* pDest;
+    U32* pSrc;
+    U32 NumWords;
+    U32 Start;
+
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGES);
+    pDest = (volatile U32*)adr;
+    pSrc = (U32*)buf;
+    NumWords = sz >> 2;
+    Start = flash_stats_now();
+    //
+    // Make sure that flash controller is in write mode
+    //
+    FLASH_REG_CONFIG = FLASH_MODE_WRITE;
+    while (NumWords--) {
+        if (!FLASH_PROGRAM_SKIP_ERASED || (*pSrc != FLASH_ERASED_WORD)) {
+            *pDest = *pSrc;
+            _WaitWordReady();
+            flash_stats.bytes_programmed += 4;
+        }
         //
-        // Wait for operation to complete
+        // Words that can't be programmed read back different
         //
-        do {
-            Status = FLASH_REG_READY;
-            if (Status & 1) {        // Flash controller ready?
-                break;
-            }
-            _FeedWDT();
-        } while(1);
-    } while(--NumWords);
+        if (*pDest != *pSrc) {
+            break;
+        }
+        pDest++;
+        pSrc++;
+    }
     //
     // Bring back flash controller into read mode
     //
     FLASH_REG_CONFIG = FLASH_MODE_READ;
-    return (0);                                  // Finished without Errors
+    flash_stats_wait(Start);
+    return flash_stats_end((U32)pDest);
+}
+
+/*
+ *  Compute the CRC-32 of every page in an address range
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes)
+ *                    crc:  One CRC per page of the range
+ *    Return Value:   0 - OK,  1 - Failed
+ */
+int compute_crc (unsigned long adr, unsigned long sz, unsigned long *crc)
+{
+    U32 PageSize;
+    U32 NumBytes;
+
+    flash_stats_begin(FLASH_STATS_COMPUTE_CRC);
+    PageSize = _PageSize;
+    while (sz) {
+        NumBytes = PageSize - (adr % PageSize);
+        if (NumBytes > sz) {
+            NumBytes = sz;
+        }
+        *crc++ = crc32(0, (const void*)adr, NumBytes);
+        adr += NumBytes;
+        sz -= NumBytes;
+        _FeedWDT();
+    }
+    return flash_stats_end(0);
+}
+
+/*
+ *  Program a Page in Flash Memory if its Contents differ
+ *    Parameter:      adr:  Page Start Address
+ *                    sz:   Size (in bytes), at most one page. A page that
+ *                          needs an erase is left alone unless it is blank past sz
+ *                    buf:  Page Data
+ *    Return Value:   FLASH_ACTION_xxx bits of what was done
+ */
+unsigned long program_sector_if_changed (unsigned long adr, unsigned long sz, unsigned char *buf)
+{
+    volatile U32* pDest;
+    U32* pSrc;
+    U32 NumWords;
+    U32 Actions;
+    U32 Start;
+    U32 SectorSize;
+
+    flash_stats_begin(FLASH_STATS_PROGRAM_SECTOR_IF_CHANGED);
+    SectorSize = _SectorSize(adr);
+    if ((adr % SectorSize) || (sz > SectorSize) || (sz & 3) || !_IsSector(adr)) {
+        return flash_stats_end(FLASH_ACTION_FAILED);
+    }
+    //
+    // NVMC writes can only clear bits, anything else needs the page erased first
+    //
+    Actions = flash_diff((const void*)adr, buf, sz, 0);
+    if (Actions & FLASH_ACTION_ERASED) {
+        //
+        // The erase would lose whatever the page holds past sz
+        //
+        if ((sz < SectorSize) && BlankCheck(adr + sz, SectorSize - sz, 0xFF)) {
+            return flash_stats_end(FLASH_ACTION_FAILED);
+        }
+        _EraseSector(adr);
+        if (ProgramPage(adr, sz, buf) != 0) {
+            return flash_stats_end(Actions | FLASH_ACTION_FAILED);
+        }
+    } else if (Actions & FLASH_ACTION_PROGRAMMED) {
+        //
+        // Only write the words that differ, a word may be written twice between erases
+        //
+        pDest = (volatile U32*)adr;
+        pSrc = (U32*)buf;
+        NumWords = sz >> 2;
+        Start = flash_stats_now();
+        FLASH_REG_CONFIG = FLASH_MODE_WRITE;
+        do {
+            if (*pDest != *pSrc) {
+                *pDest = *pSrc;
+                _WaitWordReady();
+                flash_stats.bytes_programmed += 4;
+            }
+            pDest++;
+            pSrc++;
+        } while(--NumWords);
+        FLASH_REG_CONFIG = FLASH_MODE_READ;
+        flash_stats_wait(Start);
+    }
+    //
+    // NVMC doesn't report failed writes, read the page back
+    //
+    if (Actions && (_Compare(adr, sz, (const U32*)buf, 1) != adr + sz)) {
+        Actions |= FLASH_ACTION_FAILED;
+    }
+    return flash_stats_end(Actions);
 }
@@ -116,7 +116,7 @@ struct FlashDevice const FlashDevice  =  {
    ONCHIP,                     // Device Type
    0x10000000,                 // Device Start Address
    0x00100000,                 // Device Size (1024kB)
-   256,                        // Programming Page Size
+   512,                        // Programming Page Size, the smallest IAP Copy
    0,                          // Reserved, must be 0
    0xFF,                       // Initial Content of Erased Memory
    300,                        // Program Page Timeout 300 mSec
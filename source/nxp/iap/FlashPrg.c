@@ -15,6 +15,9 @@
  */
 
 #include "../FlashOS.H"        // FlashOS Structures
+#include "crc32.h"
+#include "flash_diff.h"
+#include "flash_stats.h"
 
 // Memory Mapping Control
 #if defined(LPC11xx_32) || defined(LPC8xx_4) || defined(LPC11U68_256)
@@ -111,6 +114,21 @@
 #define FLASH_BANK_B    1
 #define FLASH_BANK(_adr)  (((_adr) >= 0x80000) ? FLASH_BANK_B : FLASH_BANK_A)
 #define FLASH_ADDR(_adr)  (((_adr) >= 0x80000) ? ((_adr) | 0x1B000000) : ((_adr) | 0x1A000000))
+#define FLASH_MAPPED(_adr) FLASH_ADDR(_adr)
+#else
+#define FLASH_MAPPED(_adr) (_adr)
+#endif
+
+/* Copy RAM to Flash sizes, powers of two from COPY_MIN to COPY_MAX except 2048 */
+#if defined(LPC8xx_4)
+#define COPY_MIN       64
+#define COPY_MAX       1024
+#elif defined(LPC4337_1024)
+#define COPY_MIN       512
+#define COPY_MAX       4096
+#else
+#define COPY_MIN       256
+#define COPY_MAX       4096
 #endif
 
 /* Code Read Protection (CRP) */
@@ -139,18 +157,38 @@ struct sIAP {                  // IAP Structure
   unsigned long res[2];        // Result
 } IAP;
 
+unsigned long Tail[COPY_MIN / 4];  // Last Copy, padded with erased bytes
+
 
-/* IAP Call */
+/* IAP Entry */
 typedef void (*IAP_Entry) (unsigned long *cmd, unsigned long *stat);
 #if defined(LPC1549_256)
-  #define IAP_Call ((IAP_Entry) 0x03000205)
+  #define IAP_Rom ((IAP_Entry) 0x03000205)
 #elif defined(LPC4337_1024)
-  #define IAP_Call ((IAP_Entry) (*(volatile unsigned int *)(0x10400100)))
+  #define IAP_Rom ((IAP_Entry) (*(volatile unsigned int *)(0x10400100)))
 #else
-#define IAP_Call ((IAP_Entry) 0x1FFF1FF1)
+#define IAP_Rom ((IAP_Entry) 0x1FFF1FF1)
 #endif
 
 
+/*
+ * IAP Call
+ *  The ROM returns once the flash is done, so the whole call is accounted as
+ *  waiting on the flash. SysTick, the timer of the Cortex-M0 parts, can't be
+ *  read inside the ROM: a command longer than its 24 bit period, like an
+ *  EraseChip of many sectors at 12 MHz, loses whole periods
+ *    Parameter:      cmd:  Command and Parameters
+ *                    stat: Status and Result
+ */
+
+static void IAP_Call (unsigned long *cmd, unsigned long *stat) {
+  unsigned long start = flash_stats_now();
+
+  IAP_Rom (cmd, stat);
+  flash_stats_wait(start);
+}
+
+
 /*
  * Get Sector Number
 
@@ -189,6 +227,47 @@ unsigned long GetSecNum (unsigned long adr) {
   return (n);                                  // Sector Number
 }
 
+
+/*
+ * Get Sector Size
+ *    Parameter:      adr:  Address in the Sector
+ *    Return Value:   Sector Size
+ */
+
+static unsigned long GetSecSize (unsigned long adr) {
+
+#if defined(LPC8xx_4)
+  return (0x0400);                             //  1kB Sector
+#elif defined(LPC11xx_32) || defined(LPC1549_256)
+  return (0x1000);                             //  4kB Sector
+#elif defined(LPC11U68_256)
+  return ((adr < 0x18000) ? 0x1000 : 0x8000);  //  4kB or 32kB Sector
+#elif defined(LPC4337_1024)
+  return (((adr & 0x7FFFF) < 0x10000) ? 0x2000 : 0x10000);  //  8kB or 64kB Sector
+#else
+  return ((adr < 0x10000) ? 0x1000 : 0x8000);  //  4kB or 32kB Sector
+#endif
+}
+
+
+/*
+ * Get Device Size
+ *    Return Value:   Bytes of the Sectors up to END_SECTOR, of both Banks
+ */
+
+static unsigned long GetDevSize (void) {
+#if defined(LPC4337_1024)
+  return (2 * 0x80000);                        // Flash Bank A and B
+#else
+  unsigned long adr = 0;
+
+  while (GetSecNum(adr) <= END_SECTOR) {
+    adr += GetSecSize(adr);
+  }
+  return (adr);
+#endif
+}
+
 #ifdef MBED
 
 /*
@@ -200,6 +279,7 @@ unsigned long GetSecNum (unsigned long adr) {
  */
 
 int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
+  flash_stats_begin(FLASH_STATS_INIT);
 
 #if defined(LPC11xx_32) || defined(LPC8xx_4) || defined(LPC11U68_256)
 
@@ -293,7 +373,7 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
   _CCLK = 60000; /* 60MHz */
 #endif
 
-  return (0);
+  return (flash_stats_end(0));
 }
 
 #else
@@ -306,6 +386,7 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
  */
 
 int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
+  flash_stats_begin(FLASH_STATS_INIT);
 
   _CCLK     = 4000;                            // 4MHz Internal RC Oscillator
 
@@ -315,7 +396,7 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
 
   MEMMAP   = 0x01;                             // User Flash Mode
 
-  return (0);
+  return (flash_stats_end(0));
 }
 #endif
 
@@ -326,7 +407,9 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
  */
 
 int UnInit (unsigned long fnc) {
-  return (0);
+  flash_stats_begin(FLASH_STATS_UNINIT);
+
+  return (flash_stats_end(0));
 }
 
 
@@ -336,6 +419,7 @@ int UnInit (unsigned long fnc) {
  */
 
 int EraseChip (void) {
+  flash_stats_begin(FLASH_STATS_ERASE_CHIP);
 
 #if defined(LPC11xx_32) || defined (LPC8xx_4)
 
@@ -343,14 +427,14 @@ int EraseChip (void) {
   IAP.par[0] = 0;                              // Start Sector
   IAP.par[1] = END_SECTOR;                     // End Sector
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (1);                    // Command Failed
+  if (IAP.stat) return (flash_stats_end(1));   // Command Failed
 
   IAP.cmd    = 52;                             // Erase Sector
   IAP.par[0] = 0;                              // Start Sector
   IAP.par[1] = END_SECTOR;                     // End Sector
   IAP.par[2] = _CCLK;                          // CCLK in kHz
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (1);                    // Command Failed
+  if (IAP.stat) return (flash_stats_end(1));   // Command Failed
 
 #elif defined(LPC4337_1024)
 
@@ -359,7 +443,7 @@ int EraseChip (void) {
   IAP.par[1] = END_SECTOR;                     // End Sector
   IAP.par[2] = FLASH_BANK_A;                   // Flash Bank
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (0xea0000 | IAP.stat);  // Command Failed
+  if (IAP.stat) return (flash_stats_end(0xea0000 | IAP.stat));  // Command Failed
 
   IAP.cmd    = 52;                             // Erase Sector
   IAP.par[0] = 0;                              // Start Sector
@@ -367,14 +451,14 @@ int EraseChip (void) {
   IAP.par[2] = _CCLK;                          // CCLK in kHz
   IAP.par[3] = FLASH_BANK_A;                   // Flash Bank
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (0xea1000 | IAP.stat);  // Command Failed
+  if (IAP.stat) return (flash_stats_end(0xea1000 | IAP.stat));  // Command Failed
 
   IAP.cmd    = 50;                             // Prepare Sector for Erase
   IAP.par[0] = 0;                              // Start Sector
   IAP.par[1] = END_SECTOR;                     // End Sector
   IAP.par[2] = FLASH_BANK_B;                   // Flash Bank
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (0xea2000 | IAP.stat);  // Command Failed
+  if (IAP.stat) return (flash_stats_end(0xea2000 | IAP.stat));  // Command Failed
 
   IAP.cmd    = 52;                             // Erase Sector
   IAP.par[0] = 0;                              // Start Sector
@@ -382,29 +466,32 @@ int EraseChip (void) {
   IAP.par[2] = _CCLK;                          // CCLK in kHz
   IAP.par[3] = FLASH_BANK_B;                   // Flash Bank
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (0xea3000 | IAP.stat);  // Command Failed
+  if (IAP.stat) return (flash_stats_end(0xea3000 | IAP.stat));  // Command Failed
 
 #else
   IAP.cmd    = 50;                             // Prepare Sector for Erase
   IAP.par[0] = 0;                              // Start Sector
   IAP.par[1] = END_SECTOR;                     // End Sector
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (1);                    // Command Failed
+  if (IAP.stat) return (flash_stats_end(1));   // Command Failed
 
   IAP.cmd    = 52;                             // Erase Sector
   IAP.par[0] = 0;                              // Start Sector
   IAP.par[1] = END_SECTOR;                     // End Sector
   IAP.par[2] = _CCLK;                          // CCLK in kHz
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (1);                    // Command Failed
+  if (IAP.stat) return (flash_stats_end(1));   // Command Failed
 #endif
 
-return (0);                                    // Finished without Errors
+  flash_stats.bytes_erased += GetDevSize();
+return (flash_stats_end(0));                   // Finished without Errors
 }
 
 
 /*
  *  Erase Sector in Flash Memory
+ *  The IAP Erase command only returns once the sector is erased, so there is
+ *  no erase_sector_start / erase_poll pair to overlap it with the host
  *    Parameter:      adr:  Sector Address
  *    Return Value:   0 - OK,  1 - Failed
  */
@@ -412,6 +499,7 @@ return (0);                                    // Finished without Errors
 int EraseSector (unsigned long adr) {
   unsigned long n;
 
+  flash_stats_begin(FLASH_STATS_ERASE_SECTOR);
   n = GetSecNum(adr);                          // Get Sector Number
 
 #if defined(LPC4337_1024)
@@ -421,7 +509,7 @@ int EraseSector (unsigned long adr) {
   IAP.par[1] = n;                              // End Sector
   IAP.par[2] = FLASH_BANK(adr);                // Flash Bank
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (0xea4000 | IAP.stat);  // Command Failed
+  if (IAP.stat) return (flash_stats_end(0xea4000 | IAP.stat));  // Command Failed
 
   IAP.cmd    = 52;                             // Erase Sector
   IAP.par[0] = n;                              // Start Sector
@@ -429,7 +517,7 @@ int EraseSector (unsigned long adr) {
   IAP.par[2] = _CCLK;                          // CCLK in kHz
   IAP.par[3] = FLASH_BANK(adr);                // Flash Bank
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (0xea5000 | IAP.stat);  // Command Failed
+  if (IAP.stat) return (flash_stats_end(0xea5000 | IAP.stat));  // Command Failed
 
 #else
 
@@ -437,30 +525,47 @@ int EraseSector (unsigned long adr) {
   IAP.par[0] = n;                              // Start Sector
   IAP.par[1] = n;                              // End Sector
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (1);                    // Command Failed
+  if (IAP.stat) return (flash_stats_end(1));   // Command Failed
 
   IAP.cmd    = 52;                             // Erase Sector
   IAP.par[0] = n;                              // Start Sector
   IAP.par[1] = n;                              // End Sector
   IAP.par[2] = _CCLK;                          // CCLK in kHz
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
-  if (IAP.stat) return (1);                    // Command Failed
+  if (IAP.stat) return (flash_stats_end(1));   // Command Failed
 
 #endif
 
-  return (0);                                  // Finished without Errors
+  flash_stats.bytes_erased += GetSecSize(adr);
+  return (flash_stats_end(0));                 // Finished without Errors
 }
 
 
 /*
- *  Program Page in Flash Memory
- *    Parameter:      adr:  Page Start Address
- *                    sz:   Page Size
- *                    buf:  Page Data
+ *  Largest Copy RAM to Flash at an Address
+ *    Parameter:      adr:  Destination Address
+ *                    sz:   Bytes left to copy, at least COPY_MIN
+ *    Return Value:   Copy Size, aligned to its own size
+ */
+
+static unsigned long CopySize (unsigned long adr, unsigned long sz) {
+  unsigned long size = COPY_MAX;
+
+  while ((size > COPY_MIN) && ((size > sz) || (adr & (size - 1)) || (size == 2048))) {
+    size >>= 1;
+  }
+  return (size);
+}
+
+
+/*
+ *  Check CRP and set the valid User Code Signature in the Vector Table
+ *    Parameter:      adr:  Start Address
+ *                    buf:  Data
  *    Return Value:   0 - OK,  1 - Failed
  */
 
-int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf) {
+static int CheckVectors (unsigned long adr, unsigned char *buf) {
   unsigned long n;
 
 #if NO_CRP != 0
@@ -487,13 +592,25 @@ int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf) {
   }
 #endif
 
-  n = GetSecNum(adr);                          // Get Sector Number
+  return (0);
+}
+
+
+/*
+ *  Prepare the Sectors and Copy RAM to Flash
+ *    Parameter:      adr:  Destination Address, aligned to size
+ *                    size: Copy Size, from CopySize
+ *                    buf:  Data, word aligned
+ *    Return Value:   0 - OK,  otherwise the status of the failed command
+ */
+
+static unsigned long Copy (unsigned long adr, unsigned long size, unsigned char *buf) {
 
 #if defined(LPC4337_1024)
 
   IAP.cmd    = 50;                             // Prepare Sector for Write
-  IAP.par[0] = n;                              // Start Sector
-  IAP.par[1] = n;                              // End Sector
+  IAP.par[0] = GetSecNum(adr);                 // Start Sector
+  IAP.par[1] = GetSecNum(adr + size - 1);      // End Sector
   IAP.par[2] = FLASH_BANK(adr);                // Flash Bank
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
   if (IAP.stat) return (0xea6000 | IAP.stat);  // Command Failed
@@ -501,7 +618,7 @@ int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf) {
   IAP.cmd    = 51;                             // Copy RAM to Flash
   IAP.par[0] = FLASH_ADDR(adr);                // Destination Flash Address
   IAP.par[1] = (unsigned long)buf;             // Source RAM Address
-  IAP.par[2] = 512;                            // Fixed Page Size
+  IAP.par[2] = size;                           // Copy Size
   IAP.par[3] = _CCLK;                          // CCLK in kHz
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
   if (IAP.stat) return (0xea7000 | IAP.stat);  // Command Failed
@@ -509,24 +626,204 @@ int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf) {
 #else
 
   IAP.cmd    = 50;                             // Prepare Sector for Write
-  IAP.par[0] = n;                              // Start Sector
-  IAP.par[1] = n;                              // End Sector
+  IAP.par[0] = GetSecNum(adr);                 // Start Sector
+  IAP.par[1] = GetSecNum(adr + size - 1);      // End Sector
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
   if (IAP.stat) return (1);                    // Command Failed
 
   IAP.cmd    = 51;                             // Copy RAM to Flash
   IAP.par[0] = adr;                            // Destination Flash Address
   IAP.par[1] = (unsigned long)buf;             // Source RAM Address
-#if defined(LPC11xx_32) || defined(LPC8xx_4) || defined(LPC1549_256) || defined(LPC11U68_256)
-  IAP.par[2] = 256;                            // Fixed Page Size
-#else
-  IAP.par[2] = 512;                            // Fixed Page Size
-#endif
+  IAP.par[2] = size;                           // Copy Size
   IAP.par[3] = _CCLK;                          // CCLK in kHz
   IAP_Call (&IAP.cmd, &IAP.stat);              // Call IAP Command
   if (IAP.stat) return (1);                    // Command Failed
 
 #endif
 
-return (0);                                  // Finished without Errors
+  flash_stats.bytes_programmed += size;
+  return (0);                                  // Finished without Errors
+}
+
+
+/*
+ *  Check for a Copy of COPY_MIN erased bytes, erased flash already reads back
+ *  as the data. Always 0 with FLASH_PROGRAM_SKIP_ERASED set to 0
+ *    Parameter:      buf:  Data, word aligned
+ *    Return Value:   1 - Erased,  0 - Needs a Copy
+ */
+
+static int CopyErased (unsigned char *buf) {
+  unsigned long n;
+
+  if (!FLASH_PROGRAM_SKIP_ERASED) return (0);
+
+  for (n = 0; n < COPY_MIN; n += 4) {
+    if (*((uint32_t *)(buf + n)) != FLASH_ERASED_WORD) return (0);
+  }
+  return (1);
+}
+
+
+/*
+ *  Program Flash with the largest Copy RAM to Flash commands the alignment
+ *  allows, leaving out erased Copies. A Copy relocks the sectors, so each one
+ *  is prepared on its own
+ *    Parameter:      adr:  Start Address, advanced past what was programmed
+ *                    sz:   Size (in bytes)
+ *                    buf:  Data
+ *    Return Value:   0 - OK,  otherwise the status of the failed command
+ */
+
+static unsigned long Program (unsigned long *adr, unsigned long sz, unsigned char *buf) {
+  unsigned long size;
+  unsigned long stat;
+  unsigned long run;
+  unsigned long n;
+
+  while (sz) {
+    if (sz < COPY_MIN) {                       // Nothing may follow the data in buf,
+      for (n = 0; n < COPY_MIN; n++) {         // pad a copy of it instead
+        ((unsigned char *)Tail)[n] = (n < sz) ? buf[n] : 0xFF;
+      }
+      buf = (unsigned char *)Tail;
+      sz  = COPY_MIN;
+    }
+
+    if (CopyErased(buf)) {                     // Nothing to write
+      *adr += COPY_MIN;
+      buf  += COPY_MIN;
+      sz   -= COPY_MIN;
+      continue;
+    }
+    run = COPY_MIN;                            // Up to the next erased Copy
+    while ((run + COPY_MIN <= sz) && !CopyErased(buf + run)) {
+      run += COPY_MIN;
+    }
+
+    size = CopySize(*adr, run);                // Largest Copy at the Address
+    stat = Copy(*adr, size, buf);
+    if (stat) return (stat);
+
+    *adr += size;
+    buf  += size;
+    sz   -= size;
+  }
+
+  return (0);                                  // Finished without Errors
+}
+
+
+/*
+ *  Program Page in Flash Memory
+ *    Parameter:      adr:  Page Start Address
+ *                    sz:   Page Size
+ *                    buf:  Page Data
+ *    Return Value:   0 - OK,  1 - Failed
+ */
+
+int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf) {
+  flash_stats_begin(FLASH_STATS_PROGRAM_PAGE);
+
+  if (CheckVectors(adr, buf)) return (flash_stats_end(1));  // CRP is enabled
+
+  return (flash_stats_end(Program(&adr, sz, buf)));
+}
+
+
+/*
+ *  Program Pages in Flash Memory
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes), any number of pages
+ *                    buf:  Data
+ *    Return Value:   (adr+sz) - OK, Failed Address
+ */
+
+unsigned long program_pages (unsigned long adr, unsigned long sz, unsigned char *buf) {
+  unsigned long end = adr + sz;
+
+  flash_stats_begin(FLASH_STATS_PROGRAM_PAGES);
+  if (CheckVectors(adr, buf)) return (flash_stats_end(adr));  // CRP is enabled
+
+  if (Program(&adr, sz, buf)) return (flash_stats_end(adr));  // Address of the failed Copy
+
+  return (flash_stats_end(end));
+}
+
+
+/*
+ *  Compute the CRC-32 of every Sector in an Address Range
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes)
+ *                    crc:  One CRC per Sector of the Range
+ *    Return Value:   0 - OK,  1 - Failed
+ */
+
+int compute_crc (unsigned long adr, unsigned long sz, unsigned long *crc) {
+  unsigned long n;
+
+  flash_stats_begin(FLASH_STATS_COMPUTE_CRC);
+  while (sz) {
+    n = GetSecSize(adr) - (adr & (GetSecSize(adr) - 1));
+    if (n > sz) n = sz;                        // Part of the last Sector
+    *crc++ = crc32(0, (const void *)FLASH_MAPPED(adr), n);
+    adr += n;
+    sz  -= n;
+  }
+
+  return (flash_stats_end(0));                 // Finished without Errors
+}
+
+
+/*
+ *  Program a Sector in Flash Memory if its Contents differ
+ *    Parameter:      adr:  Sector Start Address
+ *                    sz:   Size (in bytes), at most one sector and a multiple
+ *                          of COPY_MIN. A sector that needs an erase is left
+ *                          alone unless it is blank past sz
+ *                    buf:  Sector Data
+ *    Return Value:   FLASH_ACTION_xxx bits of what was done
+ */
+
+unsigned long program_sector_if_changed (unsigned long adr, unsigned long sz, unsigned char *buf) {
+  unsigned long actions;
+  unsigned long offset;
+  unsigned long start;
+  unsigned long n;
+
+  flash_stats_begin(FLASH_STATS_PROGRAM_SECTOR_IF_CHANGED);
+  if ((adr & (GetSecSize(adr) - 1)) || (sz > GetSecSize(adr)) || (sz % COPY_MIN)) {
+    return (flash_stats_end(FLASH_ACTION_FAILED));  // Not a whole Sector
+  }
+  if (CheckVectors(adr, buf)) return (flash_stats_end(FLASH_ACTION_FAILED));  // CRP is enabled
+
+  // A Copy writes whole flash lines with their ECC, so changes can only go
+  // into Copies of COPY_MIN bytes that are still blank
+  actions = flash_diff((const void *)FLASH_MAPPED(adr), buf, sz, COPY_MIN);
+
+  if (actions & FLASH_ACTION_ERASED) {
+    for (n = sz; n < GetSecSize(adr); n += 4) {  // The erase would lose the rest
+      if (*((volatile unsigned long *)FLASH_MAPPED(adr + n)) != FLASH_ERASED_WORD) {
+        return (flash_stats_end(FLASH_ACTION_FAILED));
+      }
+    }
+    if (EraseSector(adr)) return (flash_stats_end(actions | FLASH_ACTION_FAILED));
+    if (Program(&adr, sz, buf)) return (flash_stats_end(actions | FLASH_ACTION_FAILED));
+  } else if (actions & FLASH_ACTION_PROGRAMMED) {
+    offset = 0;
+    while (offset < sz) {                      // Program each run of changed Copies
+      start = offset;
+      while ((offset < sz) &&
+             flash_diff((const void *)FLASH_MAPPED(adr + offset), buf + offset, COPY_MIN, COPY_MIN)) {
+        offset += COPY_MIN;
+      }
+      if (offset > start) {
+        n = adr + start;
+        if (Program(&n, offset - start, buf + start)) return (flash_stats_end(actions | FLASH_ACTION_FAILED));
+      }
+      offset += COPY_MIN;
+    }
+  }
+
+  return (flash_stats_end(actions));
 }
@@ -18,6 +18,9 @@
 #include "FlashDev.h"
 
 #include "spifi_rom_api.h"
+#include "crc32.h"
+#include "flash_diff.h"
+#include "flash_stats.h"
 
 #define CGU_BASE_SPIFI0_CLK     (*(volatile unsigned long *)0x40050070)
 
@@ -42,6 +45,8 @@ unsigned long base_adr;
 int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
     int32_t rc;
 
+    flash_stats_begin(FLASH_STATS_INIT);
+
     opers.dest    = NULL;
     opers.length  = 0;
     opers.scratch = SECTOR_BUF;
@@ -64,7 +69,7 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
 
     rc = spifi_init(&obj, 3, S_RCVCLK | S_FULLCLK, 12);
 
-    return ((rc != 0) ? 1 : 0);  // 0 = No errors, 1 = Errors encountered
+    return (flash_stats_end((rc != 0) ? 1 : 0));  // 0 = No errors, 1 = Errors encountered
 }
 
 /*  De-Initialize Flash Programming Functions
@@ -72,13 +77,17 @@ int Init (unsigned long adr, unsigned long clk, unsigned long fnc) {
  *    Return Value:   0 - OK,  1 - Failed
  */
 int UnInit (unsigned long fnc) {
-    return 0;
+    flash_stats_begin(FLASH_STATS_UNINIT);
+    return (flash_stats_end(0));
 }
 
 /*  Erase complete Flash Memory
  *    Return Value:   0 - OK,  1 - Failed */
 int EraseChip (void) {
     int32_t rc;
+    uint32_t start;
+
+    flash_stats_begin(FLASH_STATS_ERASE_CHIP);
 
     opers.dest    = NULL;
     opers.length  = obj.devSize;
@@ -87,28 +96,41 @@ int EraseChip (void) {
 
     // External flash may include data or filesystem sectors.
     // Only perform chip erase when all data can be discarded.
+    start = flash_stats_now();
     rc = spifi_erase(&obj, &opers);
+    flash_stats_wait(start);
     if (rc != 0) 
-        return (rc);
+        return (flash_stats_end(rc));
 
-    return ((rc != 0) ? 1 : 0);
+    flash_stats.bytes_erased += obj.devSize;
+    return (flash_stats_end(0));
 }
 
 /*  Erase Sector in Flash Memory
+ *  spifi_erase only returns once the sector is erased, so there is
+ *  no erase_sector_start / erase_poll pair to overlap it with the host
  *    Parameter:      adr:  Sector Address
  *    Return Value:   0 - OK,  1 - Failed
  */
 int EraseSector (unsigned long adr) {
     int32_t rc;
+    uint32_t start;
+
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR);
 
     opers.dest = (char *)(adr - base_adr);
     opers.length  = FLASH_SECTOR_SIZE;
     opers.scratch = SECTOR_BUF;
     opers.options = S_VERIFY_ERASE;
 
+    start = flash_stats_now();
     rc = spifi_erase(&obj, &opers);
+    flash_stats_wait(start);
+    if (rc != 0)
+        return (flash_stats_end(1));
 
-    return ((rc != 0) ? 1 : 0);
+    flash_stats.bytes_erased += FLASH_SECTOR_SIZE;
+    return (flash_stats_end(0));
 }
 
 /*  Program Page in Flash Memory
@@ -119,6 +141,9 @@ int EraseSector (unsigned long adr) {
  */
 int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf) {
     int32_t rc;
+    uint32_t start;
+
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGE);
 
     opers.dest = (char *)(adr - base_adr);
     opers.length  = sz;
@@ -128,7 +153,96 @@ int ProgramPage (unsigned long adr, unsigned long sz, unsigned char *buf) {
     //     S_VERIFY_ERASE to erase sector before programming
     opers.options = S_VERIFY_ERASE;
 
+    start = flash_stats_now();
     rc = spifi_program(&obj, (char *)buf, &opers);
+    flash_stats_wait(start);
+    if (rc != 0)
+        return (flash_stats_end(1));
+
+    flash_stats.bytes_programmed += sz;
+    return (flash_stats_end(0));
+}
+
+/*  Program Pages in Flash Memory
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes), any number of pages
+ *                    buf:  Data
+ *    Return Value:   (adr+sz) - OK, Failed Address
+ */
+unsigned long program_pages (unsigned long adr, unsigned long sz, unsigned char *buf) {
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGES);
+
+    // spifi_program takes any length, but doesn't say where it stopped
+    if (ProgramPage(adr, sz, buf))
+        return (flash_stats_end(adr));
+
+    return (flash_stats_end(adr + sz));
+}
+
+/*  Compute the CRC-32 of every Sector in an Address Range
+ *    Parameter:      adr:  Start Address
+ *                    sz:   Size (in bytes)
+ *                    crc:  One CRC per Sector of the Range
+ *    Return Value:   0 - OK,  1 - Failed
+ */
+int compute_crc (unsigned long adr, unsigned long sz, unsigned long *crc) {
+    unsigned long n;
+
+    flash_stats_begin(FLASH_STATS_COMPUTE_CRC);
+
+    // The SPIFI is back in memory mode after every command,
+    // so the sectors are read where they are mapped
+    while (sz) {
+        n = FLASH_SECTOR_SIZE - (adr & (FLASH_SECTOR_SIZE - 1));
+        if (n > sz)
+            n = sz;                         // Part of the last sector
+        *crc++ = crc32(0, (const void *)adr, n);
+        adr += n;
+        sz  -= n;
+    }
+
+    return (flash_stats_end(0));
+}
+
+/*  Program a Sector in Flash Memory if its Contents differ
+ *    Parameter:      adr:  Sector Start Address
+ *                    sz:   Size (in bytes), at most one sector
+ *                    buf:  Sector Data
+ *    Return Value:   FLASH_ACTION_xxx bits of what was done
+ */
+unsigned long program_sector_if_changed (unsigned long adr, unsigned long sz, unsigned char *buf) {
+    unsigned long actions;
+    int32_t rc;
+    uint32_t start;
+
+    flash_stats_begin(FLASH_STATS_PROGRAM_SECTOR_IF_CHANGED);
+
+    if ((adr & (FLASH_SECTOR_SIZE - 1)) || (sz > FLASH_SECTOR_SIZE) || (sz & 3))
+        return (flash_stats_end(FLASH_ACTION_FAILED));  // Not a whole sector
 
-    return ((rc != 0) ? 1 : 0);
+    actions = flash_diff((const void *)adr, buf, sz, 4);
+    if (actions == 0)
+        return (flash_stats_end(0));
+
+    opers.dest = (char *)(adr - base_adr);
+    opers.length  = sz;
+    opers.scratch = SECTOR_BUF;
+    opers.protect = 0;
+    // Blank words take the new data without an erase. Otherwise the
+    // driver erases the sector and restores the rest of it from scratch
+    if (actions & FLASH_ACTION_ERASED)
+        opers.options = S_VERIFY_ERASE | S_VERIFY_PROG;
+    else
+        opers.options = S_CALLER_ERASE | S_VERIFY_PROG;
+
+    start = flash_stats_now();
+    rc = spifi_program(&obj, (char *)buf, &opers);
+    flash_stats_wait(start);
+    if (rc != 0)
+        return (flash_stats_end(actions | FLASH_ACTION_FAILED));
+
+    if (actions & FLASH_ACTION_ERASED)
+        flash_stats.bytes_erased += FLASH_SECTOR_SIZE;
+    flash_stats.bytes_programmed += sz;
+    return (flash_stats_end(actions));
 }
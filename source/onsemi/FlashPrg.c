@@ -24,16 +24,22 @@
 #include "clock.h"
 #include "FlashOS.h"
 #include "FlashPrg.h"
+#include "crc32.h"
 
 #define RESULT_OK                  0
 #define RESULT_ERROR               1
 #define DEVICE_OPT_REG_ADRS        (uint32_t)0x4001E000
 #define DEVICE_OPT_ALL_FEATURE_EN  (uint32_t)0x2082353F
+#define SECTOR_SIZE                (uint32_t)0x400      /* FlashDevice sector size */
+#define DEVICE_SIZE                (uint32_t)0x9F000    /* FlashDevice size, flash A and B */
+#define FLASH_B_ALIAS_OFFSET       (uint32_t)0xB0000
 
 void fInitGobjects(void);
 void fInitRam(void);  
 
 static boolean FlashBRequired;
+/** Flash bank erased by erase_sector_start() */
+static flash_options_pt EraseDevice;
 
 /** Global flash A device options */
 const flash_options_t GlobFlashOptionsA = 
@@ -59,6 +65,7 @@ uint32_t init(uint32_t adr, uint32_t clk, uint32_t fnc)
     //  access or program memory. Fnc parameter has meaning
     //  but currently isnt used in MSC programming routines
 
+    flash_stats_begin(FLASH_STATS_INIT);
     CLOCK_ENABLE(CLOCK_FLASH);
     CLOCK_ENABLE(CLOCK_DMA);
 
@@ -82,7 +89,7 @@ uint32_t init(uint32_t adr, uint32_t clk, uint32_t fnc)
 #endif
 
     fFlashIoctl((flash_options_pt)&GlobFlashOptionsB, FLASH_POWER_UP, 0);
-    return RESULT_OK;
+    return flash_stats_end(RESULT_OK);
 }
 
 uint32_t uninit(uint32_t fnc)
@@ -94,28 +101,33 @@ uint32_t uninit(uint32_t fnc)
 
     /* Optional API */
     
-    return RESULT_OK;
+    flash_stats_begin(FLASH_STATS_UNINIT);
+    return flash_stats_end(RESULT_OK);
 }
 
 uint32_t BlankCheck(uint32_t adr, uint32_t sz, uint8_t pat)
 {
     /* Optional API */
-    return RESULT_OK; 
+    flash_stats_begin(FLASH_STATS_BLANK_CHECK);
+    return flash_stats_end(RESULT_OK);
 }
 
 uint32_t eraseAll(void)
 {
     /* Erases the entire of flash memory region both flash A & B */
 
+    flash_stats_begin(FLASH_STATS_ERASE_CHIP);
     fFlashMassErase((flash_options_pt)&GlobFlashOptionsA);
     /*Shall we leave flash b alone and let in-application-programming handle its contents?*/
     fFlashMassErase((flash_options_pt)&GlobFlashOptionsB);
+    flash_stats.bytes_erased += DEVICE_SIZE;
    
-    return RESULT_OK;
+    return flash_stats_end(RESULT_OK);
 }
 
 uint32_t erase_sector(uint32_t adr)
 {
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR);
     if(adr >= FLASH_A_USER_AREA_OFFSET)
     {
         if((adr >= 0x2000) && (adr < 0x52000)) 
@@ -124,43 +136,226 @@ uint32_t erase_sector(uint32_t adr)
         }
         else if ((adr >= 0x52000) && (adr < 0xA2000)) 
         {
-            adr += 0xB0000;
+            adr += FLASH_B_ALIAS_OFFSET;
             fFlashIoctl((flash_options_pt)&GlobFlashOptionsB, FLASH_PAGE_ERASE_REQUEST, &adr);
         }
-        return RESULT_OK;
+        flash_stats.bytes_erased += SECTOR_SIZE;
+        return flash_stats_end(RESULT_OK);
     }
-    return RESULT_ERROR;
+    return flash_stats_end(RESULT_ERROR);
+}
+
+uint32_t erase_sector_start(uint32_t adr)
+{
+    /* Kick off the page erase and leave the busy flag to erase_poll() */
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR_START);
+    if((adr >= 0x2000) && (adr < 0x52000))
+    {
+        EraseDevice = (flash_options_pt)&GlobFlashOptionsA;
+    }
+    else if ((adr >= 0x52000) && (adr < 0xA2000))
+    {
+        EraseDevice = (flash_options_pt)&GlobFlashOptionsB;
+        adr += FLASH_B_ALIAS_OFFSET;
+    }
+    else
+    {
+        EraseDevice = 0;
+        return flash_stats_end(RESULT_ERROR);
+    }
+    fFlashPageErase(EraseDevice, adr);
+    flash_stats.bytes_erased += SECTOR_SIZE;
+    return flash_stats_end(RESULT_OK);
+}
+
+uint32_t erase_poll(void)
+{
+    /* 0 - done, 1 - busy */
+    flash_stats_begin(FLASH_STATS_ERASE_POLL);
+    if(EraseDevice == 0)
+    {
+        return flash_stats_end(RESULT_OK);
+    }
+    if(EraseDevice->array_base_address & FLASH_B_OFFSET_MASK)
+    {
+        return flash_stats_end(EraseDevice->membase->STATUS.BITS.FLASH_B_BUSY ? 1 : RESULT_OK);
+    }
+    return flash_stats_end(EraseDevice->membase->STATUS.BITS.FLASH_A_BUSY ? 1 : RESULT_OK);
+}
+
+/* A word of the data that needs no write, erased words already read back as the data */
+#define WORD_IS_ERASED(word)       (FLASH_PROGRAM_SKIP_ERASED && ((word) == FLASH_ERASED_WORD))
+
+static boolean write_page(flash_options_pt device, uint32_t adr, uint32_t sz, uint32_t *buf)
+{
+    uint32_t words = sz / sizeof(uint32_t);
+    uint32_t start;
+    uint32_t end = 0;
+    uint8_t *address;
+
+    if(sz % sizeof(uint32_t))
+    {
+        /* Partial words are written in one go */
+        address = (uint8_t *)adr;
+        if(fFlashWrite(device, &address, (uint8_t const *)buf, sz) != True)
+        {
+            return False;
+        }
+        flash_stats.bytes_programmed += sz;
+        return True;
+    }
+    /* Write the runs of words between the erased ones */
+    while(end < words)
+    {
+        for(start = end; (start < words) && WORD_IS_ERASED(buf[start]); start++)
+        {
+        }
+        for(end = start; (end < words) && !WORD_IS_ERASED(buf[end]); end++)
+        {
+        }
+        if(end > start)
+        {
+            address = (uint8_t *)(adr + start * sizeof(uint32_t));
+            if(fFlashWrite(device, &address, (uint8_t const *)&buf[start],
+                           (end - start) * sizeof(uint32_t)) != True)
+            {
+                return False;
+            }
+            flash_stats.bytes_programmed += (end - start) * sizeof(uint32_t);
+        }
+    }
+    return True;
 }
 
 uint32_t program_page(uint32_t adr, uint32_t sz, uint32_t *buf)
 {
     boolean retVal = True;
 
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGE);
     if(adr >= FLASH_A_USER_AREA_OFFSET)
     {
         /* Write to flash A or Flash B depending on the flash bank in use */
         if((adr >= 0x2000) && (adr < 0x52000)) 
         {
-            retVal = fFlashWrite((flash_options_pt)&GlobFlashOptionsA,(uint8_t **)&adr,
-                                               (uint8_t const *)buf,sz); 
+            retVal = write_page((flash_options_pt)&GlobFlashOptionsA, adr, sz, buf);
         }
         else if ((adr >= 0x52000) && (adr < 0xA2000)) 
         {
-            adr += 0xB0000;
-            retVal = fFlashWrite((flash_options_pt)&GlobFlashOptionsB,(uint8_t **)&adr,
-                                               (uint8_t const *)buf,sz);
+            retVal = write_page((flash_options_pt)&GlobFlashOptionsB, adr + FLASH_B_ALIAS_OFFSET, sz, buf);
         } 
 
         if(retVal == True)  
         {
-          return RESULT_OK;
+          return flash_stats_end(RESULT_OK);
         }  
     }
-    return RESULT_ERROR;
+    return flash_stats_end(RESULT_ERROR);
+}
+
+uint32_t program_pages(uint32_t adr, uint32_t sz, uint32_t *buf)
+{
+    /* One sector at a time, so that a call never spans flash A and B */
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGES);
+    while(sz)
+    {
+        uint32_t length = SECTOR_SIZE - (adr % SECTOR_SIZE);
+
+        if(length > sz)
+        {
+            length = sz;
+        }
+        if(program_page(adr, length, buf) != RESULT_OK)
+        {
+            return flash_stats_end(adr);
+        }
+        adr += length;
+        buf += length / sizeof(uint32_t);
+        sz -= length;
+    }
+    return flash_stats_end(adr);
 }
 
 uint32_t verify(uint32_t adr, uint32_t sz, uint32_t *buf)
 {
     /* Optional API */
-    return RESULT_OK;
+    flash_stats_begin(FLASH_STATS_VERIFY);
+    return flash_stats_end(RESULT_OK);
+}
+
+uint32_t compute_crc(uint32_t adr, uint32_t sz, uint32_t *crc)
+{
+    /* One CRC per sector, flash B is read where it is mapped */
+    flash_stats_begin(FLASH_STATS_COMPUTE_CRC);
+    while(sz)
+    {
+        uint32_t length = SECTOR_SIZE - (adr % SECTOR_SIZE);
+        uint32_t mapped = adr;
+
+        if(length > sz)
+        {
+            length = sz;
+        }
+        if((adr >= 0x52000) && (adr < 0xA2000))
+        {
+            mapped += FLASH_B_ALIAS_OFFSET;
+        }
+        *crc++ = crc32(0, (const void *)mapped, length);
+        adr += length;
+        sz -= length;
+    }
+    return flash_stats_end(RESULT_OK);
+}
+
+uint32_t program_sector_if_changed(uint32_t adr, uint32_t sz, uint32_t *buf)
+{
+    uint32_t mapped = adr;
+    uint32_t actions;
+    uint32_t *tail;
+    uint32_t *data;
+
+    flash_stats_begin(FLASH_STATS_PROGRAM_SECTOR_IF_CHANGED);
+    if((adr % SECTOR_SIZE) || (sz > SECTOR_SIZE) || (sz & 3))
+    {
+        return flash_stats_end(FLASH_ACTION_FAILED);
+    }
+    if((adr >= 0x52000) && (adr < 0xA2000))
+    {
+        mapped += FLASH_B_ALIAS_OFFSET;
+    }
+
+    /* The write granularity isn't documented, only program a blank sector
+     * without erasing it first */
+    actions = flash_diff((const void *)mapped, buf, sz, sz);
+    if(actions & FLASH_ACTION_ERASED)
+    {
+        /* The erase would lose whatever the sector holds past sz */
+        for(tail = (uint32_t *)(mapped + sz); tail < (uint32_t *)(mapped + SECTOR_SIZE); tail++)
+        {
+            if(*tail != FLASH_ERASED_WORD)
+            {
+                return flash_stats_end(FLASH_ACTION_FAILED);
+            }
+        }
+        if(erase_sector(adr) != RESULT_OK)
+        {
+            return flash_stats_end(actions | FLASH_ACTION_FAILED);
+        }
+    }
+    if(actions & FLASH_ACTION_PROGRAMMED)
+    {
+        if(program_page(adr, sz, buf) != RESULT_OK)
+        {
+            return flash_stats_end(actions | FLASH_ACTION_FAILED);
+        }
+    }
+
+    /* Read the sector back, a write that didn't take fails the call */
+    for(data = (uint32_t *)mapped; data < (uint32_t *)(mapped + sz); data++, buf++)
+    {
+        if(*data != *buf)
+        {
+            return flash_stats_end(actions | FLASH_ACTION_FAILED);
+        }
+    }
+    return flash_stats_end(actions);
 }
@@ -27,6 +27,7 @@
 
 #include "flash_map.h"
 #include "flash.h"
+#include "flash_stats.h"
 #include <string.h>
 
 extern int debug_flag;   
@@ -101,14 +102,23 @@ void fFlashUnlock(flash_options_pt device)
  */
 void fFlashStallUntilNotBusy(flash_options_pt device)
 {
+     uint32_t start = flash_stats_now();
+
      if (device->array_base_address & FLASH_B_OFFSET_MASK) 
      {/* Check flash B busy */
-          while (device->membase->STATUS.BITS.FLASH_B_BUSY);
+          while (device->membase->STATUS.BITS.FLASH_B_BUSY)
+          {
+               flash_stats_poll();
+          }
      }
      else
      {/* Check flash A busy */
-          while (device->membase->STATUS.BITS.FLASH_A_BUSY);
+          while (device->membase->STATUS.BITS.FLASH_A_BUSY)
+          {
+               flash_stats_poll();
+          }
      }
+     flash_stats_wait(start);
 }
 
 /** Power down the flash
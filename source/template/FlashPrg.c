@@ -18,6 +18,7 @@
 
 #include "FlashOS.h"
 #include "FlashPrg.h"
+#include "crc32.h"
 
 uint32_t Init(uint32_t adr, uint32_t clk, uint32_t fnc)
 {
@@ -25,7 +26,8 @@ uint32_t Init(uint32_t adr, uint32_t clk, uint32_t fnc)
     //  watchdogs, peripherals and anything else needed to
     //  access or program memory. Fnc parameter has meaning
     //  but currently isnt used in MSC programming routines
-    return 1;
+    flash_stats_begin(FLASH_STATS_INIT);
+    return flash_stats_end(1);
 }
 
 uint32_t UnInit(uint32_t fnc)
@@ -34,36 +36,92 @@ uint32_t UnInit(uint32_t fnc)
     //  communication channels and clocks that were enabled
     //  Fnc parameter has meaning but isnt used in MSC program
     //  routines
-    return 1;
+    flash_stats_begin(FLASH_STATS_UNINIT);
+    return flash_stats_end(1);
 }
 
 uint32_t BlankCheck(uint32_t adr, uint32_t sz, uint8_t pat)
 {
     // Check that the memory at address adr for length sz is 
     //  empty or the same as pat
-    return 1;
+    flash_stats_begin(FLASH_STATS_BLANK_CHECK);
+    return flash_stats_end(1);
 }
 
 uint32_t EraseChip(void)
 {
     // Execute a sequence that erases the entire of flash memory region 
-    return 1;
+    flash_stats_begin(FLASH_STATS_ERASE_CHIP);
+    return flash_stats_end(1);
 }
 
 uint32_t EraseSector(uint32_t adr)
 {
     // Execute a sequence that erases the sector that adr resides in
-    return 1;
+    //  and add its size to flash_stats.bytes_erased. Time the wait
+    //  for the controller with flash_stats_now() and flash_stats_wait(),
+    //  calling flash_stats_poll() in the polling loop
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR);
+    return flash_stats_end(1);
+}
+
+uint32_t erase_sector_start(uint32_t adr)
+{
+    // Start erasing the sector that adr resides in and return
+    //  without waiting for it to complete
+    flash_stats_begin(FLASH_STATS_ERASE_SECTOR_START);
+    return flash_stats_end(1);
+}
+
+uint32_t erase_poll(void)
+{
+    // Return 0 once the erase started by erase_sector_start has
+    //  completed, 1 while it is still running
+    flash_stats_begin(FLASH_STATS_ERASE_POLL);
+    return flash_stats_end(2);
 }
 
 uint32_t ProgramPage(uint32_t adr, uint32_t sz, uint32_t *buf)
 {
     // Program the contents of buf starting at adr for length of sz
-    return 1;
+    //  and add the bytes written to flash_stats.bytes_programmed.
+    //  Unless FLASH_PROGRAM_SKIP_ERASED is 0, leave out the program
+    //  units that equal FLASH_ERASED_WORD (flash_diff.h)
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGE);
+    return flash_stats_end(1);
+}
+
+uint32_t program_pages(uint32_t adr, uint32_t sz, uint32_t *buf)
+{
+    // Program sz bytes of buf from adr, any number of pages, in one
+    //  call. Return adr + sz on success or the first address that
+    //  failed
+    flash_stats_begin(FLASH_STATS_PROGRAM_PAGES);
+    return flash_stats_end(adr);
 }
 
 uint32_t Verify(uint32_t adr, uint32_t sz, uint32_t *buf)
 {
     // Given an adr and sz compare this against the content of buf
-    return 1;
+    flash_stats_begin(FLASH_STATS_VERIFY);
+    return flash_stats_end(1);
+}
+
+uint32_t compute_crc(uint32_t adr, uint32_t sz, uint32_t *crc)
+{
+    // Store crc32() of each sector touched by adr for length of sz
+    //  in consecutive entries of crc. Memory mapped flash can be
+    //  passed to crc32() directly
+    flash_stats_begin(FLASH_STATS_COMPUTE_CRC);
+    return flash_stats_end(1);
+}
+
+uint32_t program_sector_if_changed(uint32_t adr, uint32_t sz, uint32_t *buf)
+{
+    // Compare buf with the sector using flash_diff(), erase it only
+    //  if flash_diff() says so and the sector is blank past sz, and
+    //  program the changed data. Return the FLASH_ACTION_ bits of
+    //  what was done
+    flash_stats_begin(FLASH_STATS_PROGRAM_SECTOR_IF_CHANGED);
+    return flash_stats_end(FLASH_ACTION_FAILED);
 }
@@ -0,0 +1,445 @@
+"""
+FlashAlgo
+Copyright (c) 2011-2015 ARM Limited
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Runs a flash algorithm blob produced by scripts/generate_blobs.py (the
+flash_<name>.h or flash_<name>.py output) in a Thumb interpreter the way a
+debug probe does: the blob is loaded at its load address, R9 is set to the
+static base, SP to the stack pointer and LR to the BKPT at the start of the
+blob, then init, erase_sector and program_page are called in turn. Reports
+the instructions, estimated cycles and stack depth of every call.
+"""
+from __future__ import print_function
+from argparse import ArgumentParser
+import os
+import random
+import re
+import struct
+import sys
+import zlib
+
+sys.path.insert(0, os.path.dirname(os.path.realpath(__file__)))
+from thumb import Cpu, Fault, SP
+from models import Memory, Registers, BUILTIN_MODELS
+
+# Entry points a debug probe calls, in the order of program_target_t
+ENTRY_POINTS = ['init', 'uninit', 'eraseAll', 'erase_sector', 'program_page']
+OPTIONAL_ENTRY_POINTS = ['get_geometry', 'erase_sector_start', 'erase_poll', 'program_pages', 'erase_range', 'verify', 'blank_check', 'compute_crc', 'program_sector_if_changed']
+
+# Bits returned by program_sector_if_changed, see source/flash_diff.h
+FLASH_ACTION_ERASED = 1 << 0
+FLASH_ACTION_PROGRAMMED = 1 << 1
+FLASH_ACTION_FAILED = 1 << 31
+
+# flash_stats_t block, see source/flash_stats.h. Entry points in FLASH_STATS_ order
+FLASH_STATS_MAGIC = 0x46535432
+FLASH_STATS_TIMERS = ['none', 'DWT', 'SysTick', 'host']
+FLASH_STATS_ENTRIES = ['init', 'uninit', 'eraseAll', 'erase_sector', 'erase_sector_start', 'erase_poll',
+                       'erase_range', 'program_page', 'program_pages', 'program_sector_if_changed', 'verify',
+                       'blank_check', 'compute_crc', 'get_geometry']
+
+# Memory map and models of the supported targets
+TARGETS = {
+    'kinetis': {
+        'core': 'm4',
+        'models': [
+            # FTFx before the catch-all peripheral space so that it takes precedence
+            'ftfx@0x40020000',
+            # SIM_FCFG1.PFSIZE and DEPART = 0xF report the largest density of the series
+            'registers@0x40047000,size=0x2000,0x104C=0x0F000F00',
+            'registers@0x40000000,size=0x80000',
+            'scs@0xE0000000',
+            'registers@0xF0000000,size=0x10000',
+        ],
+    },
+    'nrf51': {
+        'core': 'm0',
+        'models': [
+            'nvmc@0x4001E000',
+            'registers@0x10000000,size=0x1000,0x10=1024,0x14=256',
+            'registers@0x40000000,size=0x80000',
+            # SysTick isn't implemented on the nRF51
+            'scs@0xE0000000,systick=0',
+        ],
+    },
+    'none': {
+        'core': 'm4',
+        'models': [],
+    },
+}
+
+
+class Bus(object):
+    ''' Routes CPU accesses to the attached memories and models. '''
+
+    def __init__(self):
+        self.regions = []
+        self.last = None
+        self.mmio = 0
+
+    def attach(self, model):
+        self.regions.append(model)
+
+    def find(self, address):
+        last = self.last
+        if last is not None and last.base <= address < last.base + last.size:
+            return last
+        for region in self.regions:
+            if region.base <= address < region.base + region.size:
+                self.last = region
+                return region
+        raise Fault('access to unmapped address 0x%08x' % address)
+
+    def read(self, address, size):
+        region = self.find(address)
+        if not isinstance(region, Memory):
+            self.mmio += 1
+        return region.read(address - region.base, size)
+
+    def write(self, address, size, value):
+        region = self.find(address)
+        if not isinstance(region, Memory):
+            self.mmio += 1
+        region.write(address - region.base, size, value)
+
+
+def load_module(path):
+    name = os.path.splitext(os.path.basename(path))[0]
+    try:
+        from importlib.util import spec_from_file_location, module_from_spec
+    except ImportError:
+        import imp
+        return imp.load_source(name, path)
+    spec = spec_from_file_location(name, path)
+    module = module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+class Machine(object):
+    ''' CPU, RAM, flash and peripheral models. '''
+
+    def __init__(self, core, clock, ram_base, ram_size, flash_base, flash_size):
+        self.clock = clock
+        self.bus = Bus()
+        self.cpu = Cpu(self.bus, core)
+        self.ram = Memory(self, ram_base, ram_size, name='RAM')
+        self.flash = Memory(self, flash_base, flash_size, fill=0xFF, writable=False, name='flash')
+        self.bus.attach(self.ram)
+        self.bus.attach(self.flash)
+        self.models = []
+
+    def add_model(self, spec):
+        ''' Attach a model from "name@address[,option=value...]" or "file.py:Class@address[,...]". '''
+        name, _, rest = spec.partition('@')
+        fields = rest.split(',')
+        options = dict(field.split('=', 1) for field in fields[1:])
+        if ':' in name:
+            path, class_name = name.rsplit(':', 1)
+            cls = getattr(load_module(path), class_name)
+        else:
+            cls = BUILTIN_MODELS[name]
+        model = cls(self, int(fields[0], 0), **options)
+        self.bus.attach(model)
+        self.models.append(model)
+        return model
+
+
+def evaluate(expression):
+    ''' Value of a sum of integer literals as written by the blob templates. '''
+    expression = expression.strip()
+    if not re.match(r'^[0-9a-fA-FxX+ ]+$', expression):
+        raise ValueError('cannot evaluate %r' % expression)
+    return sum(int(term, 0) for term in expression.split('+') if term.strip())
+
+
+def load_c_blob(text):
+    ''' Parse the flash_<name>.h output of c_blob.tmpl. '''
+    blob = {}
+    words = re.search(r'_flash_prog_blob\[\]\s*=\s*\{(.*?)\};', text, re.S).group(1)
+    blob['instructions'] = [int(word, 0) for word in re.findall(r'0x[0-9a-fA-F]+', words)]
+    target = re.search(r'program_target_t\s+\w+\s*=\s*\{(.*)\};', text, re.S).group(1)
+    target = re.sub(r'//[^\n]*', '', target)
+    fields = [field.strip() for field in target.replace('{', ',').replace('}', ',').split(',') if field.strip()]
+    for name, field in zip(ENTRY_POINTS, fields):
+        blob['pc_' + name] = evaluate(field)
+    blob['breakpoint'] = evaluate(fields[5])
+    blob['static_base'] = evaluate(fields[6])
+    blob['begin_stack'] = evaluate(fields[7])
+    blob['begin_data'] = evaluate(fields[8])
+    blob['load_address'] = evaluate(fields[9])
+    blob['max_program_length'] = evaluate(fields[-1])
+    for name, value in re.findall(r'#define\s+\w+_FLASH_(\w+)\s+(0x[0-9a-fA-F]+)', text):
+        blob['pc_' + name.lower()] = int(value, 0)
+    if 'pc_stats' in blob:
+        blob['stats_address'] = blob.pop('pc_stats')
+    buffers = re.search(r'#define\s+\w+_FLASH_PAGE_BUFFERS\s+\{(.*?)\}', text)
+    if buffers:
+        blob['page_buffers'] = [int(word, 0) for word in re.findall(r'0x[0-9a-fA-F]+', buffers.group(1))]
+    sectors = re.search(r'#define\s+\w+_FLASH_SECTORS\s+\{(.*?)\n\}', text, re.S)
+    if sectors:
+        blob['sectors'] = [tuple(int(word, 0) for word in row.split(','))
+                           for row in re.findall(r'\{([^{}]*)\}', sectors.group(1))]
+    return blob
+
+
+def load_py_blob(text):
+    ''' Parse the flash_<name>.py output of py_blob.tmpl. '''
+    blob = {}
+    words = re.search(r"'instructions'\s*:\s*\[(.*?)\]", text, re.S).group(1)
+    blob['instructions'] = [int(word, 0) for word in re.findall(r'0x[0-9a-fA-F]+', words)]
+    for key, value in re.findall(r"'(\w+)'\s*:\s*([0-9a-fA-FxX+ ]+),", text):
+        blob.setdefault(key, evaluate(value))
+    buffers = re.search(r"'page_buffers'\s*:\s*\[(.*?)\]", text, re.S)
+    if buffers:
+        blob['page_buffers'] = [int(word, 0) for word in re.findall(r'0x[0-9a-fA-F]+', buffers.group(1))]
+    sectors = re.search(r"'sectors'\s*:\s*\[(.*?)\]", text, re.S)
+    if sectors:
+        blob['sectors'] = [tuple(int(word, 0) for word in row.split(','))
+                           for row in re.findall(r'\(([^()]*)\)', sectors.group(1))]
+    blob['breakpoint'] = blob['load_address'] + 1
+    return blob
+
+
+def load_blob(path):
+    text = open(path).read()
+    if path.endswith('.py'):
+        return load_py_blob(text)
+    return load_c_blob(text)
+
+
+def report_flash_stats(machine, address, stats):
+    ''' Print the flash_stats_t block of the algorithm. Returns the number of
+    entry points that didn't count the calls made. '''
+    words = [machine.bus.read(address + 4 * i, 4) for i in range(4 + 4 * len(FLASH_STATS_ENTRIES))]
+    if words[0] != FLASH_STATS_MAGIC:
+        print('flash_stats: no block at 0x%08x' % address)
+        return 1
+    timer = FLASH_STATS_TIMERS[words[1]] if words[1] < len(FLASH_STATS_TIMERS) else str(words[1])
+    print('flash_stats at 0x%08x: timer %s, %d bytes programmed, %d bytes erased' % (
+        address, timer, words[2], words[3]))
+    print('%-26s %6s %14s %14s %14s' % ('flash_stats', 'calls', 'cycles avg', 'cycles max', 'wait avg'))
+    errors = 0
+    for index, name in enumerate(FLASH_STATS_ENTRIES):
+        calls, cycles, max_cycles, wait_cycles = words[4 + 4 * index:8 + 4 * index]
+        if calls:
+            print('%-26s %6d %14d %14d %14d' % (name, calls, cycles // calls, max_cycles, wait_cycles // calls))
+        made = stats[name].calls if name in stats else 0
+        if calls != made:
+            print('flash_stats: %s counted %d calls, %d were made' % (name, calls, made))
+            errors += 1
+    return errors
+
+
+class CallStats(object):
+    def __init__(self):
+        self.calls = 0
+        self.instructions = []
+        self.cycles = []
+        self.stack = 0
+        self.mmio = 0
+
+
+def main():
+    parser = ArgumentParser(description='Run a generated flash algorithm blob in a Thumb interpreter')
+    parser.add_argument('blob', help='flash_<name>.h or flash_<name>.py written by generate_blobs.py')
+    parser.add_argument('--target', choices=sorted(TARGETS), default='kinetis', help='peripheral models to attach')
+    parser.add_argument('--core', choices=['m0', 'm0plus', 'm3', 'm4'], help='instruction set and timings')
+    parser.add_argument('--model', action='append', default=[],
+                        help='extra model, name@address[,option=value...] or file.py:Class@address[,...]')
+    parser.add_argument('--clock', type=int, default=48000000, help='core clock in Hz, passed to init')
+    parser.add_argument('--flash-base', type=lambda x: int(x, 0), default=0)
+    parser.add_argument('--flash-size', type=lambda x: int(x, 0), default=0x40000)
+    parser.add_argument('--ram-size', type=lambda x: int(x, 0), default=0x4000, help='RAM from the load address')
+    parser.add_argument('--sector-size', type=lambda x: int(x, 0),
+                        help='the sector size of the blob at --flash-base by default')
+    parser.add_argument('--sectors', type=int, default=4,
+                        help='sectors to erase and program, 0 for all of the flash')
+    parser.add_argument('--page-size', type=lambda x: int(x, 0),
+                        help='bytes per program_page call, the largest transfer of the blob by default')
+    parser.add_argument('--erase-async', type=float, metavar='US',
+                        help='erase with erase_sector_start and call erase_poll every US microseconds')
+    parser.add_argument('--program-pages', action='store_true',
+                        help='program each buffer with one program_pages call instead of program_page')
+    parser.add_argument('--limit', type=int, default=50000000, help='instructions allowed per call')
+    parser.add_argument('-v', '--verbose', action='store_true', help='report every call')
+    args = parser.parse_args()
+
+    blob = load_blob(args.blob)
+    if args.page_size is None:
+        args.page_size = blob.get('max_program_length', 0x200)
+    if args.sector_size is None:
+        args.sector_size = 0x400
+        for size, start, count in blob.get('sectors', []):
+            if start <= args.flash_base:
+                args.sector_size = size
+    target = TARGETS[args.target]
+    load_address = blob['load_address']
+    machine = Machine(args.core or target['core'], args.clock, load_address, args.ram_size,
+                      args.flash_base, args.flash_size)
+    for spec in target['models'] + args.model:
+        machine.add_model(spec)
+
+    code = bytearray()
+    for word in blob['instructions']:
+        code += bytearray([(word >> (8 * i)) & 0xFF for i in range(4)])
+    if len(code) > args.ram_size:
+        print('blob of %d bytes does not fit in %d bytes of RAM' % (len(code), args.ram_size))
+        return 1
+    machine.ram.load(0, code)
+    blob_end = load_address + len(code)
+    buffers = blob.get('page_buffers') or [blob['begin_data']]
+    for buffer in buffers:
+        if buffer < blob_end or blob['begin_stack'] > buffer:
+            print('warning: page buffer at 0x%08x overlaps the blob or the stack' % buffer)
+
+    cpu = machine.cpu
+    stats = {}
+    failures = [0]
+
+    def call(name, *call_args):
+        if 'pc_' + name not in blob:
+            raise Fault('the blob has no %s entry point' % name)
+        before = (cpu.instructions, cpu.cycles, machine.bus.mmio)
+        result = cpu.call(blob['pc_' + name], call_args, blob['begin_stack'], blob['breakpoint'],
+                          blob.get('static_base'), args.limit)
+        entry = stats.setdefault(name, CallStats())
+        entry.calls += 1
+        entry.instructions.append(cpu.instructions - before[0])
+        entry.cycles.append(cpu.cycles - before[1])
+        entry.mmio += machine.bus.mmio - before[2]
+        entry.stack = max(entry.stack, blob['begin_stack'] - cpu.min_sp)
+        if cpu.min_sp < blob_end:
+            print('warning: %s grew the stack into the blob (SP 0x%08x)' % (name, cpu.min_sp))
+        if args.verbose:
+            print('%-14s %-34s -> 0x%08x  %8d instructions %10d cycles' % (
+                name, ', '.join('0x%x' % a for a in call_args), result,
+                entry.instructions[-1], entry.cycles[-1]))
+        if name == 'program_sector_if_changed':
+            failed = result & FLASH_ACTION_FAILED
+        elif name == 'erase_poll':
+            failed = result not in (0, 1)
+        elif name == 'program_pages':
+            failed = result != call_args[0] + call_args[1]
+        else:
+            failed = result != 0
+        if failed:
+            print('%s(%s) returned 0x%x' % (name, ', '.join('0x%x' % a for a in call_args), result))
+            failures[0] += 1
+        return result
+
+    rng = random.Random(1)
+    blob_sectors = blob.get('sectors')
+    device_start = blob_sectors[0][1] if blob_sectors else machine.flash.base
+    device_end = machine.flash.base + machine.flash.size
+
+    try:
+        call('init', args.flash_base, args.clock, 1)
+        if 'pc_get_geometry' in blob:
+            # The part can have less flash than the blob describes, size the erase plan to what it has
+            call('get_geometry', buffers[0])
+            page_size, pages = struct.unpack('<2I', bytes(machine.ram.data[buffers[0] - load_address:][:8]))
+            device_end = min(device_end, device_start + page_size * pages)
+            print('get_geometry: %d pages of %d bytes' % (pages, page_size))
+        available = max(0, device_end - args.flash_base) // args.sector_size
+        if not args.sectors:
+            args.sectors = available
+        elif args.sectors > available:
+            print('only %d sectors from 0x%08x, the erase plan is cut to them' % (available, args.flash_base))
+            args.sectors = available
+        image = bytearray(rng.randrange(256) for _ in range(args.sectors * args.sector_size))
+
+        if args.flash_base == device_start and args.flash_base + len(image) == device_end and args.erase_async is None:
+            # The plan covers all of the flash, one chip erase is cheaper than erasing every sector
+            call('eraseAll')
+            sectors_to_erase = []
+        else:
+            sectors_to_erase = range(args.sectors)
+        for sector in sectors_to_erase:
+            if args.erase_async is None:
+                call('erase_sector', args.flash_base + sector * args.sector_size)
+                continue
+            # The target runs on while the host does other work between polls
+            call('erase_sector_start', args.flash_base + sector * args.sector_size)
+            while True:
+                cpu.cycles += int(args.erase_async * args.clock / 1e6)
+                if call('erase_poll') != 1:
+                    break
+        call('uninit', 1)
+
+        call('init', args.flash_base, args.clock, 2)
+        program = 'program_pages' if args.program_pages else 'program_page'
+        for index, offset in enumerate(range(0, len(image), args.page_size)):
+            page = image[offset:offset + args.page_size]
+            buffer = buffers[index % len(buffers)]
+            machine.ram.load(buffer - load_address, page)
+            call(program, args.flash_base + offset, len(page), buffer)
+        if 'pc_compute_crc' in blob:
+            call('compute_crc', args.flash_base, len(image), buffers[0])
+            crcs = struct.unpack('<%dI' % args.sectors,
+                                 bytes(machine.ram.data[buffers[0] - load_address:][:4 * args.sectors]))
+            for sector in range(args.sectors):
+                data = bytes(image[sector * args.sector_size:(sector + 1) * args.sector_size])
+                if crcs[sector] != zlib.crc32(data) & 0xFFFFFFFF:
+                    print('compute_crc: wrong CRC for sector 0x%x' % (args.flash_base + sector * args.sector_size))
+                    failures[0] += 1
+        if 'pc_program_sector_if_changed' in blob:
+            # Reflash with one byte changed, only its sector should be rewritten
+            image[rng.randrange(len(image))] ^= 0xFF
+            actions = []
+            for offset in range(0, len(image), args.sector_size):
+                sector = image[offset:offset + args.sector_size]
+                machine.ram.load(buffers[0] - load_address, sector)
+                actions.append(call('program_sector_if_changed', args.flash_base + offset, len(sector), buffers[0]))
+            skipped = actions.count(0)
+            print('program_sector_if_changed: %d skipped, %d programmed, %d erased' % (
+                skipped, len(actions) - skipped, sum(1 for action in actions if action & FLASH_ACTION_ERASED)))
+            if skipped != len(actions) - 1:
+                print('program_sector_if_changed: expected exactly one sector to change')
+                failures[0] += 1
+        call('uninit', 2)
+    except Fault as fault:
+        print('fault: %s at pc 0x%08x' % (fault, fault.pc if fault.pc is not None else cpu.pc))
+        print('  ' + ' '.join('r%d=%08x' % (i, cpu.r[i]) for i in range(8)))
+        print('  ' + ' '.join('r%d=%08x' % (i, cpu.r[i]) for i in range(8, 16)))
+        return 1
+
+    flash_offset = args.flash_base - machine.flash.base
+    if machine.flash.data[flash_offset:flash_offset + len(image)] != image:
+        print('flash contents do not match the programmed image')
+        failures[0] += 1
+
+    print('%-26s %6s %12s %12s %14s %14s %8s %8s' % (
+        'entry point', 'calls', 'instr avg', 'instr max', 'cycles avg', 'cycles max', 'stack', 'mmio'))
+    for name in ENTRY_POINTS + OPTIONAL_ENTRY_POINTS:
+        entry = stats.get(name)
+        if entry:
+            print('%-26s %6d %12d %12d %14d %14d %8d %8d' % (
+                name, entry.calls, sum(entry.instructions) // entry.calls, max(entry.instructions),
+                sum(entry.cycles) // entry.calls, max(entry.cycles), entry.stack, entry.mmio))
+    if 'stats_address' in blob:
+        failures[0] += report_flash_stats(machine, blob['stats_address'], stats)
+    for model in machine.models:
+        counters = model.report()
+        if counters:
+            print('%s@0x%08x: %s' % (type(model).__name__, model.base,
+                                     ', '.join('%s=%d' % item for item in sorted(counters.items()))))
+
+    return 1 if failures[0] else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,409 @@
+"""
+FlashAlgo
+Copyright (c) 2011-2015 ARM Limited
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Memory and peripheral models for blob_exec.py.
+
+A model is attached to the bus at a base address and receives every access in
+[base, base + size) as read(offset, size) and write(offset, size, value).
+Models can be loaded from any python file with --model file.py:Class@address,
+the class is constructed as Class(machine, base, **options) and may use
+machine.cpu.cycles, machine.clock and machine.flash.
+"""
+from __future__ import print_function
+from thumb import Fault
+
+
+class Model(object):
+    ''' Base class of the memory-mapped peripheral models. '''
+    size = 0x1000
+
+    def __init__(self, machine, base, **options):
+        self.machine = machine
+        self.base = base
+        if 'size' in options:
+            self.size = int(options['size'], 0)
+
+    def read(self, offset, size):
+        return 0
+
+    def write(self, offset, size, value):
+        pass
+
+    def report(self):
+        ''' Counters printed with the per-call statistics. '''
+        return {}
+
+
+class Memory(Model):
+    ''' RAM or flash contents. CPU writes go to write_handler when one is set. '''
+
+    def __init__(self, machine, base, size, fill=0x00, writable=True, name='memory'):
+        Model.__init__(self, machine, base)
+        self.size = size
+        self.data = bytearray([fill]) * size
+        self.writable = writable
+        self.write_handler = None
+        self.name = name
+
+    def read(self, offset, size):
+        data = self.data
+        if size == 4:
+            return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | (data[offset + 3] << 24)
+        if size == 2:
+            return data[offset] | (data[offset + 1] << 8)
+        return data[offset]
+
+    def write(self, offset, size, value):
+        if self.write_handler:
+            self.write_handler(self, offset, size, value)
+            return
+        if not self.writable:
+            raise Fault('write to %s at 0x%08x' % (self.name, self.base + offset))
+        self.store(offset, size, value)
+
+    def store(self, offset, size, value):
+        for i in range(size):
+            self.data[offset + i] = (value >> (8 * i)) & 0xFF
+        self.machine.cpu.invalidate(self.base + offset, size)
+
+    def load(self, offset, data):
+        self.data[offset:offset + len(data)] = data
+
+
+class Registers(Model):
+    ''' Plain register file, reads return what was last written.
+
+    Options: size, and offset=value pairs for the reset values.
+    '''
+
+    def __init__(self, machine, base, **options):
+        Model.__init__(self, machine, base, **options)
+        self.data = bytearray(self.size)
+        self.accesses = 0
+        for key, value in options.items():
+            if key != 'size':
+                self.poke(int(key, 0), int(value, 0))
+
+    def poke(self, offset, value, size=4):
+        for i in range(size):
+            self.data[offset + i] = (value >> (8 * i)) & 0xFF
+
+    def peek(self, offset, size=4):
+        return sum(self.data[offset + i] << (8 * i) for i in range(size))
+
+    def read(self, offset, size):
+        self.accesses += 1
+        return self.peek(offset, size)
+
+    def write(self, offset, size, value):
+        self.accesses += 1
+        self.poke(offset, value, size)
+
+
+class Ftfx(Registers):
+    ''' Freescale FTFA/FTFE/FTFL flash controller.
+
+    Options: sector, block, unit (write unit), section (RD1SEC/PGMSEC unit), flexram
+    (FlexRAM size) and the command latencies in microseconds: pgm, ersscr,
+    ersblk, ersall, rd1sec, pgmsec.
+    '''
+    FSTAT, FCNFG = 0x0, 0x1
+    CCIF, RDCOLERR, ACCERR, FPVIOL, MGSTAT0 = 0x80, 0x40, 0x20, 0x10, 0x01
+    RAMRDY = 0x02
+    FLEXRAM_BASE = 0x14000000
+
+    def __init__(self, machine, base, **options):
+        Registers.__init__(self, machine, base, size=options.pop('size', '0x40'))
+        self.sector = int(options.get('sector', '1024'), 0)
+        self.block = int(options.get('block', str(machine.flash.size)), 0)
+        self.unit = int(options.get('unit', '4'), 0)
+        self.section = int(options.get('section', str(self.unit)), 0)
+        self.latency = dict((name, float(options.get(name, default))) for name, default in
+                            (('pgm', '65'), ('ersscr', '14000'), ('ersblk', '225000'), ('ersall', '450000'),
+                             ('rd1sec', '20'), ('pgmsec', '1000')))
+        self.busy_until = None
+        self.commands = {}
+        self.polls = 0
+        self.data[self.FSTAT] = self.CCIF
+        self.flexram = None
+        flexram_size = int(options.get('flexram', '0'), 0)
+        if flexram_size:
+            self.flexram = Memory(machine, self.FLEXRAM_BASE, flexram_size)
+            machine.bus.attach(self.flexram)
+            self.data[self.FCNFG] = self.RAMRDY
+
+    def fccob(self, n):
+        return self.data[4 + (n & ~3) + 3 - (n & 3)]
+
+    def read(self, offset, size):
+        if offset == self.FSTAT:
+            self.polls += 1
+            if self.busy_until is not None and self.machine.cpu.cycles >= self.busy_until:
+                self.busy_until = None
+                self.data[self.FSTAT] |= self.CCIF | self.pending
+        return Registers.read(self, offset, size)
+
+    def write(self, offset, size, value):
+        if offset != self.FSTAT:
+            if self.busy_until is not None and 4 <= offset < 16:
+                raise Fault('FCCOB written while a command is running')
+            return Registers.write(self, offset, size, value)
+        self.accesses += 1
+        value &= 0xFF
+        self.data[self.FSTAT] &= ~(value & (self.ACCERR | self.FPVIOL | self.RDCOLERR)) & 0xFF
+        if value & self.CCIF:
+            if self.busy_until is not None:
+                raise Fault('CCIF written while a command is running')
+            self.launch()
+
+    def launch(self):
+        command = self.fccob(0)
+        address = (self.fccob(1) << 16) | (self.fccob(2) << 8) | self.fccob(3)
+        self.commands[command] = self.commands.get(command, 0) + 1
+        self.data[self.FSTAT] &= ~(self.CCIF | self.MGSTAT0) & 0xFF
+        self.pending = 0
+        flash = self.machine.flash
+        latency = 0
+        error = False
+
+        if command in (0x06, 0x07):
+            length = 4 if command == 0x06 else 8
+            if length != self.unit or address % length or address + length > flash.size:
+                error = True
+            else:
+                for i in range(length):
+                    flash.data[address + i] &= self.data[8 + i]
+                latency = self.latency['pgm']
+        elif command == 0x09:
+            if address % self.unit or address >= flash.size:
+                error = True
+            else:
+                start = address - address % self.sector
+                flash.data[start:start + self.sector] = bytearray([0xFF]) * self.sector
+                latency = self.latency['ersscr']
+        elif command == 0x08:
+            start = address - address % self.block
+            flash.data[start:start + self.block] = bytearray([0xFF]) * self.block
+            latency = self.latency['ersblk']
+        elif command == 0x44:
+            flash.data[:] = bytearray([0xFF]) * flash.size
+            latency = self.latency['ersall']
+        elif command == 0x01:
+            length = ((self.fccob(4) << 8) | self.fccob(5)) * self.section
+            if not length or address % self.section or address + length > flash.size:
+                error = True
+            else:
+                if flash.data[address:address + length] != bytearray([0xFF]) * length:
+                    self.pending = self.MGSTAT0
+                latency = self.latency['rd1sec']
+        elif command in (0x00, 0x40):
+            if flash.data != bytearray([0xFF]) * flash.size:
+                self.pending = self.MGSTAT0
+            latency = self.latency['rd1sec']
+        elif command == 0x02:
+            if address % 4 or address + 4 > flash.size:
+                error = True
+            elif flash.data[address:address + 4] != self.data[12:16]:
+                self.pending = self.MGSTAT0
+            latency = self.latency['rd1sec']
+        elif command == 0x0B:
+            length = ((self.fccob(4) << 8) | self.fccob(5)) * self.section
+            if not self.flexram or not (self.data[self.FCNFG] & self.RAMRDY) or not length \
+                    or length > self.flexram.size or address % self.section or address + length > flash.size:
+                error = True
+            else:
+                for i in range(length):
+                    flash.data[address + i] &= self.flexram.data[i]
+                latency = self.latency['pgmsec']
+        elif command == 0x81:
+            if self.flexram and self.fccob(1) == 0xFF:
+                self.data[self.FCNFG] |= self.RAMRDY
+            elif self.flexram and self.fccob(1) == 0x00:
+                self.data[self.FCNFG] &= ~self.RAMRDY & 0xFF
+            else:
+                error = True
+        else:
+            error = True
+
+        if error:
+            self.data[self.FSTAT] |= self.CCIF | self.ACCERR
+            return
+        self.busy_until = self.machine.cpu.cycles + int(latency * self.machine.clock / 1e6)
+
+    def report(self):
+        counters = dict(('cmd_%02x' % command, count) for command, count in self.commands.items())
+        counters['fstat_polls'] = self.polls
+        return counters
+
+
+class Nvmc(Registers):
+    ''' Nordic nRF51 non-volatile memory controller.
+
+    Flash and UICR writes are accepted when CONFIG.WEN is set and program the
+    word; ERASEPAGE, ERASEALL and ERASEUICR erase. Options: page (code page
+    size), uicr (UICR address) and the latencies in microseconds: write,
+    erasepage, eraseall.
+    '''
+    READY, CONFIG, ERASEPAGE, ERASEALL, ERASEPCR0, ERASEUICR = 0x400, 0x504, 0x508, 0x50C, 0x510, 0x514
+
+    def __init__(self, machine, base, **options):
+        Registers.__init__(self, machine, base)
+        self.page = int(options.get('page', '1024'), 0)
+        self.latency = dict((name, float(options.get(name, default))) for name, default in
+                            (('write', '46'), ('erasepage', '22300'), ('eraseall', '22300')))
+        self.busy_until = None
+        self.writes = 0
+        self.erases = 0
+        self.polls = 0
+        self.uicr = Memory(machine, int(options.get('uicr', '0x10001000'), 0), 0x100, fill=0xFF, name='UICR')
+        machine.bus.attach(self.uicr)
+        machine.flash.write_handler = self.program
+        self.uicr.write_handler = self.program
+
+    def busy(self, latency):
+        if self.busy_until is not None:
+            raise Fault('NVMC accessed while not ready')
+        self.busy_until = self.machine.cpu.cycles + int(latency * self.machine.clock / 1e6)
+
+    def ready(self):
+        if self.busy_until is not None and self.machine.cpu.cycles >= self.busy_until:
+            self.busy_until = None
+        return self.busy_until is None
+
+    def program(self, memory, offset, size, value):
+        if (self.peek(self.CONFIG) & 3) != 1:
+            raise Fault('write to %s at 0x%08x without CONFIG.WEN' % (memory.name, memory.base + offset))
+        if size != 4 or offset % 4:
+            raise Fault('%d byte write to %s at 0x%08x' % (size, memory.name, memory.base + offset))
+        self.ready()
+        self.busy(self.latency['write'])
+        self.writes += 1
+        memory.store(offset, 4, memory.read(offset, 4) & value)
+
+    def read(self, offset, size):
+        if offset == self.READY:
+            self.polls += 1
+            self.accesses += 1
+            return int(self.ready())
+        return Registers.read(self, offset, size)
+
+    def write(self, offset, size, value):
+        Registers.write(self, offset, size, value)
+        if offset not in (self.ERASEPAGE, self.ERASEALL, self.ERASEPCR0, self.ERASEUICR):
+            return
+        if (self.peek(self.CONFIG) & 3) != 2:
+            raise Fault('NVMC erase without CONFIG.EEN')
+        self.ready()
+        flash = self.machine.flash
+        if offset in (self.ERASEPAGE, self.ERASEPCR0):
+            if value % self.page or value >= flash.size:
+                raise Fault('ERASEPAGE of 0x%08x' % value)
+            flash.data[value:value + self.page] = bytearray([0xFF]) * self.page
+            self.busy(self.latency['erasepage'])
+        elif offset == self.ERASEALL and value & 1:
+            flash.data[:] = bytearray([0xFF]) * flash.size
+            self.uicr.data[:] = bytearray([0xFF]) * self.uicr.size
+            self.busy(self.latency['eraseall'])
+        elif offset == self.ERASEUICR and value & 1:
+            self.uicr.data[:] = bytearray([0xFF]) * self.uicr.size
+            self.busy(self.latency['erasepage'])
+        self.erases += 1
+
+    def report(self):
+        return {'nvmc_writes': self.writes, 'nvmc_erases': self.erases, 'ready_polls': self.polls}
+
+
+class Scs(Registers):
+    ''' System control space at 0xE0000000 with SysTick and the DWT cycle
+    counter running on machine.cpu.cycles, other registers are plain.
+
+    ARMv6-M cores have no CYCCNT (DWT_CTRL.NOCYCCNT reads as 1). Options:
+    size, systick=0 for a core without SysTick, its registers then read as 0.
+    '''
+    DWT_CTRL, DWT_CYCCNT = 0x1000, 0x1004
+    SYST_CSR, SYST_RVR, SYST_CVR = 0xE010, 0xE014, 0xE018
+    DEMCR = 0xEDFC
+    CYCCNTENA, NOCYCCNT, TRCENA = 1 << 0, 1 << 25, 1 << 24
+    ENABLE, COUNTFLAG = 1 << 0, 1 << 16
+
+    def __init__(self, machine, base, **options):
+        self.systick = options.pop('systick', '1') != '0'
+        options.setdefault('size', '0x100000')
+        Registers.__init__(self, machine, base, **options)
+        self.cyccnt = 0
+        self.cyccnt_at = 0
+        self.syst_at = 0
+        self.wraps = 0
+
+    def cyccnt_enabled(self):
+        return (self.machine.cpu.v7 and (self.peek(self.DEMCR) & self.TRCENA) and
+                (self.peek(self.DWT_CTRL) & self.CYCCNTENA))
+
+    def sync(self):
+        ''' Advance CYCCNT and SysTick to the current cycle. '''
+        cycles = self.machine.cpu.cycles
+        if self.cyccnt_enabled():
+            self.cyccnt = (self.cyccnt + cycles - self.cyccnt_at) & 0xFFFFFFFF
+        self.cyccnt_at = cycles
+        csr = self.peek(self.SYST_CSR)
+        if self.systick and (csr & self.ENABLE):
+            ticks = cycles - self.syst_at
+            current = self.peek(self.SYST_CVR)
+            period = (self.peek(self.SYST_RVR) & 0xFFFFFF) + 1
+            if ticks > current:
+                self.poke(self.SYST_CVR, period - 1 - (ticks - current - 1) % period)
+                self.poke(self.SYST_CSR, csr | self.COUNTFLAG)
+                self.wraps += 1
+            else:
+                self.poke(self.SYST_CVR, current - ticks)
+        self.syst_at = cycles
+
+    def read(self, offset, size):
+        self.sync()
+        if offset in (self.SYST_CSR, self.SYST_RVR, self.SYST_CVR) and not self.systick:
+            return 0
+        if offset == self.DWT_CTRL and not self.machine.cpu.v7:
+            return Registers.read(self, offset, size) | self.NOCYCCNT
+        if offset == self.DWT_CYCCNT:
+            self.accesses += 1
+            return self.cyccnt if self.machine.cpu.v7 else 0
+        value = Registers.read(self, offset, size)
+        if offset == self.SYST_CSR:
+            self.poke(self.SYST_CSR, value & ~self.COUNTFLAG)
+        return value
+
+    def write(self, offset, size, value):
+        self.sync()
+        if offset == self.DWT_CYCCNT:
+            self.cyccnt = value
+        elif offset == self.SYST_CVR:
+            # Any write clears the counter, it reloads on the next tick
+            Registers.write(self, offset, size, self.peek(self.SYST_RVR) & 0xFFFFFF)
+            self.poke(self.SYST_CSR, self.peek(self.SYST_CSR) & ~self.COUNTFLAG)
+        else:
+            Registers.write(self, offset, size, value)
+
+    def report(self):
+        return {'systick_wraps': self.wraps} if self.wraps else {}
+
+
+BUILTIN_MODELS = {
+    'registers': Registers,
+    'ftfx': Ftfx,
+    'nvmc': Nvmc,
+    'scs': Scs,
+}
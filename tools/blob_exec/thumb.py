@@ -0,0 +1,1225 @@
+"""
+FlashAlgo
+Copyright (c) 2011-2015 ARM Limited
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+
+Thumb instruction set interpreter for running flash algorithm blobs on the
+host. It covers the ARMv6-M instruction set and the ARMv7-M Thumb-2 integer
+instructions a compiler emits for flash algorithms; there is no FPU, no
+exception model and no privilege levels. Cycle counts are estimates based on
+the Cortex-M technical reference manuals for code running from zero wait state
+RAM.
+"""
+from __future__ import print_function
+
+MASK32 = 0xFFFFFFFF
+SP, LR, PC = 13, 14, 15
+
+# Cycle estimates per instruction class, see the "Processor instruction
+# timings" tables of the Cortex-M0, M0+, M3 and M4 TRMs
+TIMING = {
+    'm0':     {'alu': 1, 'load': 2, 'store': 2, 'branch': 3, 'bl': 4, 'bx': 3, 'mul': 1, 'mull': 0, 'div': 0, 'it': 0},
+    'm0plus': {'alu': 1, 'load': 2, 'store': 2, 'branch': 2, 'bl': 3, 'bx': 2, 'mul': 1, 'mull': 0, 'div': 0, 'it': 0},
+    'm3':     {'alu': 1, 'load': 2, 'store': 2, 'branch': 3, 'bl': 3, 'bx': 3, 'mul': 1, 'mull': 4, 'div': 7, 'it': 1},
+    'm4':     {'alu': 1, 'load': 2, 'store': 2, 'branch': 3, 'bl': 3, 'bx': 3, 'mul': 1, 'mull': 1, 'div': 7, 'it': 1},
+}
+
+
+class Fault(Exception):
+    ''' The blob did something a Cortex-M would fault on, or that isn't modelled. '''
+    def __init__(self, message, pc=None):
+        Exception.__init__(self, message)
+        self.pc = pc
+
+
+class Breakpoint(Exception):
+    ''' A BKPT instruction was executed. '''
+    def __init__(self, pc, imm):
+        Exception.__init__(self, 'BKPT #%d at 0x%08x' % (imm, pc))
+        self.pc = pc
+        self.imm = imm
+
+
+def sign_extend(value, bits):
+    sign = 1 << (bits - 1)
+    return (value & (sign - 1)) - (value & sign)
+
+
+def add_with_carry(x, y, carry):
+    unsigned = x + y + carry
+    result = unsigned & MASK32
+    signed = sign_extend(x, 32) + sign_extend(y, 32) + carry
+    return result, int(unsigned > MASK32), int(sign_extend(result, 32) != signed)
+
+
+def shift_c(value, kind, amount, carry):
+    ''' Shift_C() of the ARM ARM; kind 0 LSL, 1 LSR, 2 ASR, 3 ROR, 4 RRX. '''
+    if kind == 4:
+        return ((carry << 31) | (value >> 1)) & MASK32, value & 1
+    if amount == 0:
+        return value, carry
+    if kind == 0:
+        if amount > 32:
+            return 0, 0
+        return (value << amount) & MASK32, (value >> (32 - amount)) & 1
+    if kind == 1:
+        if amount > 32:
+            return 0, 0
+        return value >> amount, (value >> (amount - 1)) & 1
+    if kind == 2:
+        if amount >= 32:
+            bit = value >> 31
+            return (MASK32 if bit else 0), bit
+        return (sign_extend(value, 32) >> amount) & MASK32, (value >> (amount - 1)) & 1
+    amount &= 31
+    if amount == 0:
+        return value, value >> 31
+    result = ((value >> amount) | (value << (32 - amount))) & MASK32
+    return result, result >> 31
+
+
+def decode_imm_shift(kind, imm5):
+    ''' DecodeImmShift(): returns (kind, amount) with RRX as kind 4. '''
+    if kind == 0:
+        return 0, imm5
+    if kind in (1, 2):
+        return kind, imm5 or 32
+    return (3, imm5) if imm5 else (4, 1)
+
+
+def thumb_expand_imm_c(imm12, carry):
+    if (imm12 >> 10) == 0:
+        imm8 = imm12 & 0xFF
+        kind = (imm12 >> 8) & 3
+        if kind == 0:
+            return imm8, carry
+        if kind == 1:
+            return (imm8 << 16) | imm8, carry
+        if kind == 2:
+            return (imm8 << 24) | (imm8 << 8), carry
+        return (imm8 << 24) | (imm8 << 16) | (imm8 << 8) | imm8, carry
+    unrotated = 0x80 | (imm12 & 0x7F)
+    amount = imm12 >> 7
+    result = ((unrotated >> amount) | (unrotated << (32 - amount))) & MASK32
+    return result, result >> 31
+
+
+def bit_count(value):
+    return bin(value).count('1')
+
+
+class Cpu(object):
+    ''' Cortex-M integer core executing Thumb code from a Bus. '''
+
+    def __init__(self, bus, core='m4'):
+        if core not in TIMING:
+            raise ValueError('unknown core %s' % core)
+        self.bus = bus
+        self.core = core
+        self.v7 = core in ('m3', 'm4')
+        self.t = TIMING[core]
+        self.r = [0] * 16
+        self.n = self.z = self.c = self.v = 0
+        self.it = []
+        self.in_it = False
+        self.pc = 0
+        self.npc = 0
+        self.cycles = 0
+        self.instructions = 0
+        self.min_sp = 0
+        self._decoded = {}
+
+    # ---- register and memory helpers --------------------------------------
+
+    def reg(self, n):
+        return (self.pc + 4) & MASK32 if n == PC else self.r[n]
+
+    def set_reg(self, n, value):
+        if n == PC:
+            self.npc = value & ~1 & MASK32
+        else:
+            self.r[n] = value & MASK32
+
+    def bx_write_pc(self, value):
+        if not value & 1:
+            raise Fault('interworking branch to ARM state (0x%08x)' % value, self.pc)
+        self.npc = value & ~1 & MASK32
+
+    def load(self, address, size, strict=False):
+        address &= MASK32
+        if address % size and (strict or not self.v7):
+            raise Fault('unaligned %d byte load from 0x%08x' % (size, address), self.pc)
+        return self.bus.read(address, size)
+
+    def store(self, address, size, value, strict=False):
+        address &= MASK32
+        if address % size and (strict or not self.v7):
+            raise Fault('unaligned %d byte store to 0x%08x' % (size, address), self.pc)
+        self.bus.write(address, size, value & ((1 << (8 * size)) - 1))
+
+    def set_nz(self, result):
+        self.n = result >> 31
+        self.z = int(result == 0)
+
+    def condition(self, cond):
+        if cond == 0:
+            return self.z
+        if cond == 1:
+            return not self.z
+        if cond == 2:
+            return self.c
+        if cond == 3:
+            return not self.c
+        if cond == 4:
+            return self.n
+        if cond == 5:
+            return not self.n
+        if cond == 6:
+            return self.v
+        if cond == 7:
+            return not self.v
+        if cond == 8:
+            return self.c and not self.z
+        if cond == 9:
+            return not self.c or self.z
+        if cond == 10:
+            return self.n == self.v
+        if cond == 11:
+            return self.n != self.v
+        if cond == 12:
+            return not self.z and self.n == self.v
+        if cond == 13:
+            return self.z or self.n != self.v
+        return True
+
+    # ---- execution --------------------------------------------------------
+
+    def invalidate(self, address, length):
+        ''' Forget decoded instructions in a range the bus has written to. '''
+        if self._decoded:
+            for a in range(address & ~1, address + length, 2):
+                self._decoded.pop(a, None)
+                self._decoded.pop(a - 2, None)
+
+    def step(self):
+        pc = self.pc
+        entry = self._decoded.get(pc)
+        if entry is None:
+            entry = self.decode(pc)
+            self._decoded[pc] = entry
+        op, size = entry
+        self.npc = pc + size
+        self.instructions += 1
+        if self.it:
+            cond = self.it.pop(0)
+            self.in_it = True
+            if not self.condition(cond):
+                self.cycles += 1
+                self.pc = self.npc
+                return
+        else:
+            self.in_it = False
+        op(self)
+        self.pc = self.npc
+        if self.r[SP] < self.min_sp:
+            self.min_sp = self.r[SP]
+
+    def call(self, address, args, sp, lr, static_base=None, limit=10000000):
+        ''' Call the function at @a address and run until it returns to the BKPT at @a lr.
+
+        Returns R0. Raises Fault if the function faults or runs for more than
+        @a limit instructions.
+        '''
+        for i in range(4):
+            self.r[i] = args[i] & MASK32 if i < len(args) else 0
+        if static_base is not None:
+            self.r[9] = static_base & MASK32
+        self.r[SP] = sp
+        self.r[LR] = lr | 1
+        self.min_sp = sp
+        self.it = []
+        self.pc = address & ~1
+        stop = lr & ~1
+        executed = self.instructions + limit
+        try:
+            while self.instructions < executed:
+                self.step()
+        except Breakpoint as bkpt:
+            if bkpt.pc != stop:
+                raise Fault(str(bkpt), bkpt.pc)
+            return self.r[0]
+        raise Fault('no return after %d instructions' % limit, self.pc)
+
+    # ---- decoding ---------------------------------------------------------
+
+    def fetch16(self, address):
+        return self.bus.read(address, 2)
+
+    def decode(self, pc):
+        hw1 = self.fetch16(pc)
+        if (hw1 >> 11) in (0x1D, 0x1E, 0x1F):
+            hw2 = self.fetch16(pc + 2)
+            if not self.v7 and not ((hw1 >> 11) == 0x1E and (hw2 & 0xD000) == 0xD000) \
+                    and not ((hw1 & 0xFFE0) == 0xF380 or (hw1 & 0xFFE0) == 0xF3E0
+                             or (hw1 & 0xFFF0) == 0xF3B0):
+                return self.undefined(hw1, hw2), 4
+            return self.decode32(hw1, hw2), 4
+        return self.decode16(hw1), 2
+
+    def undefined(self, hw1, hw2=None):
+        text = '0x%04x' % hw1 if hw2 is None else '0x%04x 0x%04x' % (hw1, hw2)
+
+        def op(cpu):
+            raise Fault('undefined instruction %s for %s' % (text, cpu.core), cpu.pc)
+        return op
+
+    # 16-bit encodings ---------------------------------------------------------
+
+    def decode16(self, hw):
+        t = self.t
+        top = hw >> 10
+        rd = hw & 7
+        rn = (hw >> 3) & 7
+
+        if top < 0x10:
+            group = (hw >> 11) & 7
+            if group < 3:
+                imm5 = (hw >> 6) & 31
+                kind, amount = decode_imm_shift(group, imm5)
+                if group == 0 and imm5 == 0:
+                    kind = 0
+
+                def op(cpu):
+                    result, carry = shift_c(cpu.r[rn], kind, amount, cpu.c)
+                    cpu.r[rd] = result
+                    if not cpu.in_it:
+                        cpu.set_nz(result)
+                        cpu.c = carry
+                    cpu.cycles += t['alu']
+                return op
+            if group == 3:
+                sub = (hw >> 9) & 1
+                immediate = (hw >> 10) & 1
+                rm = (hw >> 6) & 7
+
+                def op(cpu):
+                    y = rm if immediate else cpu.r[rm]
+                    if sub:
+                        result, carry, overflow = add_with_carry(cpu.r[rn], ~y & MASK32, 1)
+                    else:
+                        result, carry, overflow = add_with_carry(cpu.r[rn], y, 0)
+                    cpu.r[rd] = result
+                    if not cpu.in_it:
+                        cpu.set_nz(result)
+                        cpu.c, cpu.v = carry, overflow
+                    cpu.cycles += t['alu']
+                return op
+            rdn = (hw >> 8) & 7
+            imm8 = hw & 0xFF
+            if group == 4:
+                def op(cpu):
+                    cpu.r[rdn] = imm8
+                    if not cpu.in_it:
+                        cpu.set_nz(imm8)
+                    cpu.cycles += t['alu']
+                return op
+
+            def op(cpu):
+                if group == 6:
+                    result, carry, overflow = add_with_carry(cpu.r[rdn], imm8, 0)
+                else:
+                    result, carry, overflow = add_with_carry(cpu.r[rdn], ~imm8 & MASK32, 1)
+                if group != 5:
+                    cpu.r[rdn] = result
+                if group == 5 or not cpu.in_it:
+                    cpu.set_nz(result)
+                    cpu.c, cpu.v = carry, overflow
+                cpu.cycles += t['alu']
+            return op
+
+        if top == 0x10:
+            opc = (hw >> 6) & 15
+            rm = rn
+
+            def op(cpu):
+                a = cpu.r[rd]
+                b = cpu.r[rm]
+                carry, overflow = cpu.c, cpu.v
+                write = True
+                if opc == 0:
+                    result = a & b
+                elif opc == 1:
+                    result = a ^ b
+                elif opc in (2, 3, 4, 7):
+                    result, carry = shift_c(a, {2: 0, 3: 1, 4: 2, 7: 3}[opc], b & 0xFF, cpu.c)
+                elif opc == 5:
+                    result, carry, overflow = add_with_carry(a, b, cpu.c)
+                elif opc == 6:
+                    result, carry, overflow = add_with_carry(a, ~b & MASK32, cpu.c)
+                elif opc == 8:
+                    result = a & b
+                    write = False
+                elif opc == 9:
+                    result, carry, overflow = add_with_carry(~b & MASK32, 0, 1)
+                    a = None
+                elif opc == 10:
+                    result, carry, overflow = add_with_carry(a, ~b & MASK32, 1)
+                    write = False
+                elif opc == 11:
+                    result, carry, overflow = add_with_carry(a, b, 0)
+                    write = False
+                elif opc == 12:
+                    result = a | b
+                elif opc == 13:
+                    result = (a * b) & MASK32
+                elif opc == 14:
+                    result = a & ~b & MASK32
+                else:
+                    result = ~b & MASK32
+                if write:
+                    cpu.r[rd] = result
+                if not write or not cpu.in_it:
+                    cpu.set_nz(result)
+                    if opc != 13:
+                        cpu.c, cpu.v = carry, overflow
+                cpu.cycles += t['mul'] if opc == 13 else t['alu']
+            return op
+
+        if top == 0x11:
+            opc = (hw >> 8) & 3
+            rm = (hw >> 3) & 15
+            rdn = ((hw >> 4) & 8) | rd
+            if opc == 3:
+                link = (hw >> 7) & 1
+
+                def op(cpu):
+                    target = cpu.r[rm]
+                    if link:
+                        cpu.r[LR] = (cpu.pc + 2) | 1
+                    cpu.bx_write_pc(target)
+                    cpu.cycles += t['bx']
+                return op
+            if opc == 1:
+                def op(cpu):
+                    result, carry, overflow = add_with_carry(cpu.reg(rdn), ~cpu.reg(rm) & MASK32, 1)
+                    cpu.set_nz(result)
+                    cpu.c, cpu.v = carry, overflow
+                    cpu.cycles += t['alu']
+                return op
+
+            def op(cpu):
+                if opc == 0:
+                    result = (cpu.reg(rdn) + cpu.reg(rm)) & MASK32
+                else:
+                    result = cpu.reg(rm)
+                cpu.set_reg(rdn, result)
+                cpu.cycles += t['branch'] if rdn == PC else t['alu']
+            return op
+
+        if top in (0x12, 0x13):
+            rt = (hw >> 8) & 7
+            imm = (hw & 0xFF) << 2
+
+            def op(cpu):
+                cpu.r[rt] = cpu.load(((cpu.pc + 4) & ~3) + imm, 4)
+                cpu.cycles += t['load']
+            return op
+
+        if (hw >> 12) == 5:
+            opc = (hw >> 9) & 7
+            rm = (hw >> 6) & 7
+            size = (4, 2, 1, 1, 4, 2, 1, 2)[opc]
+
+            def op(cpu):
+                address = (cpu.r[rn] + cpu.r[rm]) & MASK32
+                if opc < 3:
+                    cpu.store(address, size, cpu.r[rd])
+                    cpu.cycles += t['store']
+                    return
+                value = cpu.load(address, size)
+                if opc == 3:
+                    value = sign_extend(value, 8) & MASK32
+                elif opc == 7:
+                    value = sign_extend(value, 16) & MASK32
+                cpu.r[rd] = value
+                cpu.cycles += t['load']
+            return op
+
+        if (hw >> 13) == 3 or (hw >> 12) == 8:
+            if (hw >> 12) == 8:
+                size = 2
+            else:
+                size = 1 if (hw >> 12) & 1 else 4
+            is_load = (hw >> 11) & 1
+            imm = ((hw >> 6) & 31) * size
+
+            def op(cpu):
+                address = cpu.r[rn] + imm
+                if is_load:
+                    cpu.r[rd] = cpu.load(address, size)
+                    cpu.cycles += t['load']
+                else:
+                    cpu.store(address, size, cpu.r[rd])
+                    cpu.cycles += t['store']
+            return op
+
+        if (hw >> 12) == 9:
+            is_load = (hw >> 11) & 1
+            rt = (hw >> 8) & 7
+            imm = (hw & 0xFF) << 2
+
+            def op(cpu):
+                address = cpu.r[SP] + imm
+                if is_load:
+                    cpu.r[rt] = cpu.load(address, 4)
+                    cpu.cycles += t['load']
+                else:
+                    cpu.store(address, 4, cpu.r[rt])
+                    cpu.cycles += t['store']
+            return op
+
+        if (hw >> 12) == 10:
+            rdx = (hw >> 8) & 7
+            imm = (hw & 0xFF) << 2
+            use_sp = (hw >> 11) & 1
+
+            def op(cpu):
+                base = cpu.r[SP] if use_sp else (cpu.pc + 4) & ~3
+                cpu.r[rdx] = (base + imm) & MASK32
+                cpu.cycles += t['alu']
+            return op
+
+        if (hw >> 12) == 11:
+            return self.decode16_misc(hw)
+
+        if (hw >> 12) == 12:
+            is_load = (hw >> 11) & 1
+            rb = (hw >> 8) & 7
+            regs = [i for i in range(8) if hw & (1 << i)]
+            if not regs:
+                return self.undefined(hw)
+
+            def op(cpu):
+                address = cpu.r[rb]
+                for i in regs:
+                    if is_load:
+                        cpu.r[i] = cpu.load(address, 4, strict=True)
+                    else:
+                        cpu.store(address, 4, cpu.r[i], strict=True)
+                    address += 4
+                if not is_load or rb not in regs:
+                    cpu.r[rb] = address & MASK32
+                cpu.cycles += 1 + len(regs)
+            return op
+
+        if (hw >> 12) == 13:
+            cond = (hw >> 8) & 15
+            if cond == 14:
+                return self.undefined(hw)
+            if cond == 15:
+                def op(cpu):
+                    raise Fault('SVC #%d' % (hw & 0xFF), cpu.pc)
+                return op
+            offset = sign_extend(hw & 0xFF, 8) << 1
+
+            def op(cpu):
+                if cpu.condition(cond):
+                    cpu.npc = (cpu.pc + 4 + offset) & MASK32
+                    cpu.cycles += t['branch']
+                else:
+                    cpu.cycles += 1
+            return op
+
+        if (hw >> 11) == 0x1C:
+            offset = sign_extend(hw & 0x7FF, 11) << 1
+
+            def op(cpu):
+                cpu.npc = (cpu.pc + 4 + offset) & MASK32
+                cpu.cycles += t['branch']
+            return op
+
+        return self.undefined(hw)
+
+    def decode16_misc(self, hw):
+        t = self.t
+        sub = (hw >> 8) & 15
+
+        if sub == 0:
+            imm = (hw & 0x7F) << 2
+            negative = (hw >> 7) & 1
+
+            def op(cpu):
+                cpu.r[SP] = (cpu.r[SP] - imm if negative else cpu.r[SP] + imm) & MASK32
+                cpu.cycles += t['alu']
+            return op
+
+        if sub in (1, 3, 9, 11):
+            if not self.v7:
+                return self.undefined(hw)
+            nonzero = (hw >> 11) & 1
+            rn = hw & 7
+            offset = (((hw >> 9) & 1) << 6) | (((hw >> 3) & 31) << 1)
+
+            def op(cpu):
+                if (cpu.r[rn] != 0) == bool(nonzero):
+                    cpu.npc = (cpu.pc + 4 + offset) & MASK32
+                    cpu.cycles += t['branch']
+                else:
+                    cpu.cycles += 1
+            return op
+
+        if sub == 2:
+            opc = (hw >> 6) & 3
+            rd = hw & 7
+            rm = (hw >> 3) & 7
+
+            def op(cpu):
+                value = cpu.r[rm]
+                if opc == 0:
+                    value = sign_extend(value & 0xFFFF, 16) & MASK32
+                elif opc == 1:
+                    value = sign_extend(value & 0xFF, 8) & MASK32
+                elif opc == 2:
+                    value &= 0xFFFF
+                else:
+                    value &= 0xFF
+                cpu.r[rd] = value
+                cpu.cycles += t['alu']
+            return op
+
+        if sub in (4, 5):
+            regs = [i for i in range(8) if hw & (1 << i)]
+            if sub == 5:
+                regs.append(LR)
+
+            def op(cpu):
+                address = cpu.r[SP] - 4 * len(regs)
+                cpu.r[SP] = address & MASK32
+                for i in regs:
+                    cpu.store(address, 4, cpu.r[i], strict=True)
+                    address += 4
+                cpu.cycles += 1 + len(regs)
+            return op
+
+        if sub == 6:
+            # CPS: interrupts are not modelled
+            def op(cpu):
+                cpu.cycles += 1
+            return op
+
+        if sub == 10:
+            opc = (hw >> 6) & 3
+            rd = hw & 7
+            rm = (hw >> 3) & 7
+            if opc == 2:
+                return self.undefined(hw)
+
+            def op(cpu):
+                value = cpu.r[rm]
+                if opc == 0:
+                    value = ((value & 0xFF) << 24) | ((value & 0xFF00) << 8) | ((value >> 8) & 0xFF00) | (value >> 24)
+                elif opc == 1:
+                    value = ((value & 0x00FF00FF) << 8) | ((value >> 8) & 0x00FF00FF)
+                else:
+                    value = sign_extend(((value & 0xFF) << 8) | ((value >> 8) & 0xFF), 16) & MASK32
+                cpu.r[rd] = value
+                cpu.cycles += t['alu']
+            return op
+
+        if sub in (12, 13):
+            regs = [i for i in range(8) if hw & (1 << i)]
+            pop_pc = sub == 13
+
+            def op(cpu):
+                address = cpu.r[SP]
+                for i in regs:
+                    cpu.r[i] = cpu.load(address, 4, strict=True)
+                    address += 4
+                cycles = 1 + len(regs)
+                if pop_pc:
+                    target = cpu.load(address, 4, strict=True)
+                    address += 4
+                    cycles += t['bx']
+                cpu.r[SP] = address & MASK32
+                if pop_pc:
+                    cpu.bx_write_pc(target)
+                cpu.cycles += cycles
+            return op
+
+        if sub == 14:
+            imm = hw & 0xFF
+
+            def op(cpu):
+                raise Breakpoint(cpu.pc, imm)
+            return op
+
+        if sub == 15:
+            mask = hw & 15
+            if mask == 0:
+                # NOP, YIELD, WFE, WFI, SEV
+                def op(cpu):
+                    cpu.cycles += 1
+                return op
+            if not self.v7:
+                return self.undefined(hw)
+            firstcond = (hw >> 4) & 15
+            conds = [firstcond]
+            length = 4 - ((mask & -mask).bit_length() - 1)
+            for i in range(1, length):
+                bit = (mask >> (4 - i)) & 1
+                conds.append((firstcond & ~1) | bit)
+
+            def op(cpu):
+                cpu.it = list(conds)
+                cpu.cycles += t['it']
+            return op
+
+        return self.undefined(hw)
+
+    # 32-bit encodings ---------------------------------------------------------
+
+    def decode32(self, hw1, hw2):
+        op1 = (hw1 >> 11) & 3
+        if op1 == 1:
+            if (hw1 >> 9) & 3 == 0:
+                if (hw1 >> 6) & 1 == 0:
+                    return self.decode_ldm_stm(hw1, hw2)
+                return self.decode_dual(hw1, hw2)
+            if (hw1 >> 9) & 3 == 1:
+                return self.decode_dp_shifted(hw1, hw2)
+            return self.undefined(hw1, hw2)
+        if op1 == 2:
+            if hw2 & 0x8000:
+                return self.decode_branch_misc(hw1, hw2)
+            if hw1 & 0x0200:
+                return self.decode_dp_plain_imm(hw1, hw2)
+            return self.decode_dp_modified_imm(hw1, hw2)
+        sel = (hw1 >> 4) & 0x7F
+        if (sel & 0x71) == 0x00:
+            return self.decode_store_single(hw1, hw2)
+        if (sel & 0x67) in (0x01, 0x03, 0x05):
+            return self.decode_load_single(hw1, hw2)
+        if (sel & 0x70) == 0x20:
+            return self.decode_dp_register(hw1, hw2)
+        if (sel & 0x78) == 0x30:
+            return self.decode_multiply(hw1, hw2)
+        if (sel & 0x78) == 0x38:
+            return self.decode_long_multiply(hw1, hw2)
+        return self.undefined(hw1, hw2)
+
+    def decode_ldm_stm(self, hw1, hw2):
+        mode = (hw1 >> 7) & 3
+        writeback = (hw1 >> 5) & 1
+        is_load = (hw1 >> 4) & 1
+        rn = hw1 & 15
+        regs = [i for i in range(16) if hw2 & (1 << i)]
+        if mode not in (1, 2) or not regs:
+            return self.undefined(hw1, hw2)
+
+        def op(cpu):
+            base = cpu.r[rn]
+            address = base if mode == 1 else base - 4 * len(regs)
+            final = base + 4 * len(regs) if mode == 1 else address
+            cycles = 1 + len(regs)
+            target = None
+            for i in regs:
+                if is_load:
+                    value = cpu.load(address, 4, strict=True)
+                    if i == PC:
+                        target = value
+                        cycles += cpu.t['bx']
+                    else:
+                        cpu.r[i] = value
+                else:
+                    cpu.store(address, 4, cpu.r[i], strict=True)
+                address += 4
+            if writeback and not (is_load and rn in regs):
+                cpu.r[rn] = final & MASK32
+            if target is not None:
+                cpu.bx_write_pc(target)
+            cpu.cycles += cycles
+        return op
+
+    def decode_dual(self, hw1, hw2):
+        t = self.t
+        op1 = (hw1 >> 7) & 3
+        op2 = (hw1 >> 4) & 3
+        rn = hw1 & 15
+        rt = (hw2 >> 12) & 15
+
+        if op1 == 1 and op2 == 1 and (hw2 & 0xE0) == 0:
+            half = (hw2 >> 4) & 1
+            rm = hw2 & 15
+
+            def op(cpu):
+                base = cpu.reg(rn)
+                if half:
+                    entry = cpu.load(base + 2 * cpu.r[rm], 2)
+                else:
+                    entry = cpu.load(base + cpu.r[rm], 1)
+                cpu.npc = (cpu.pc + 4 + 2 * entry) & MASK32
+                cpu.cycles += t['load'] + t['branch']
+            return op
+
+        if op1 == 0 and op2 in (0, 1):
+            # LDREX/STREX: a single core always owns the exclusive monitor
+            imm = (hw2 & 0xFF) << 2
+            rd = (hw2 >> 8) & 15
+
+            def op(cpu):
+                address = cpu.r[rn] + imm
+                if op2 == 1:
+                    cpu.r[rt] = cpu.load(address, 4, strict=True)
+                    cpu.cycles += t['load']
+                else:
+                    cpu.store(address, 4, cpu.r[rt], strict=True)
+                    cpu.r[rd] = 0
+                    cpu.cycles += t['store']
+            return op
+
+        if (hw1 >> 8) & 1 or (hw1 >> 5) & 1:
+            index = (hw1 >> 8) & 1
+            add = (hw1 >> 7) & 1
+            writeback = (hw1 >> 5) & 1
+            is_load = (hw1 >> 4) & 1
+            rt2 = (hw2 >> 8) & 15
+            imm = (hw2 & 0xFF) << 2
+
+            def op(cpu):
+                base = (cpu.reg(rn) & ~3) if rn == PC else cpu.r[rn]
+                offset_address = (base + imm if add else base - imm) & MASK32
+                address = offset_address if index else base
+                if is_load:
+                    cpu.r[rt] = cpu.load(address, 4, strict=True)
+                    cpu.r[rt2] = cpu.load(address + 4, 4, strict=True)
+                    cpu.cycles += 1 + t['load']
+                else:
+                    cpu.store(address, 4, cpu.r[rt], strict=True)
+                    cpu.store(address + 4, 4, cpu.r[rt2], strict=True)
+                    cpu.cycles += 1 + t['store']
+                if writeback:
+                    cpu.r[rn] = offset_address
+            return op
+
+        return self.undefined(hw1, hw2)
+
+    def data_processing(self, opc, rn, rd, setflags, hw1, hw2, operand):
+        ''' Shared body of the shifted register and modified immediate forms.
+
+        @a operand(cpu) returns (value, carry) of the second operand.
+        '''
+        t = self.t
+        if opc in (0, 4, 8, 13) and rd == PC and setflags:
+            compare = True
+        else:
+            compare = False
+        logical = opc in (0, 1, 2, 3, 4)
+        if opc not in (0, 1, 2, 3, 4, 8, 10, 11, 13, 14):
+            return self.undefined(hw1, hw2)
+
+        def op(cpu):
+            value, carry = operand(cpu)
+            a = cpu.reg(rn)
+            overflow = cpu.v
+            if opc == 0:
+                result = a & value
+            elif opc == 1:
+                result = a & ~value & MASK32
+            elif opc == 2:
+                result = value if rn == PC else a | value
+            elif opc == 3:
+                result = (~value & MASK32) if rn == PC else (a | ~value) & MASK32
+            elif opc == 4:
+                result = a ^ value
+            elif opc == 8:
+                result, carry, overflow = add_with_carry(a, value, 0)
+            elif opc == 10:
+                result, carry, overflow = add_with_carry(a, value, cpu.c)
+            elif opc == 11:
+                result, carry, overflow = add_with_carry(a, ~value & MASK32, cpu.c)
+            elif opc == 13:
+                result, carry, overflow = add_with_carry(a, ~value & MASK32, 1)
+            else:
+                result, carry, overflow = add_with_carry(~a & MASK32, value, 1)
+            if not compare:
+                cpu.set_reg(rd, result)
+            if setflags:
+                cpu.set_nz(result)
+                cpu.c = carry
+                if not logical:
+                    cpu.v = overflow
+            cpu.cycles += t['alu']
+        return op
+
+    def decode_dp_shifted(self, hw1, hw2):
+        opc = (hw1 >> 5) & 15
+        setflags = (hw1 >> 4) & 1
+        rn = hw1 & 15
+        rd = (hw2 >> 8) & 15
+        rm = hw2 & 15
+        imm5 = (((hw2 >> 12) & 7) << 2) | ((hw2 >> 6) & 3)
+        kind, amount = decode_imm_shift((hw2 >> 4) & 3, imm5)
+
+        def operand(cpu):
+            return shift_c(cpu.reg(rm), kind, amount, cpu.c)
+        return self.data_processing(opc, rn, rd, setflags, hw1, hw2, operand)
+
+    def decode_dp_modified_imm(self, hw1, hw2):
+        opc = (hw1 >> 5) & 15
+        setflags = (hw1 >> 4) & 1
+        rn = hw1 & 15
+        rd = (hw2 >> 8) & 15
+        imm12 = (((hw1 >> 10) & 1) << 11) | (((hw2 >> 12) & 7) << 8) | (hw2 & 0xFF)
+
+        def operand(cpu):
+            return thumb_expand_imm_c(imm12, cpu.c)
+        return self.data_processing(opc, rn, rd, setflags, hw1, hw2, operand)
+
+    def decode_dp_plain_imm(self, hw1, hw2):
+        t = self.t
+        opc = (hw1 >> 4) & 31
+        rn = hw1 & 15
+        rd = (hw2 >> 8) & 15
+        imm12 = (((hw1 >> 10) & 1) << 11) | (((hw2 >> 12) & 7) << 8) | (hw2 & 0xFF)
+
+        if opc in (0, 10):
+            def op(cpu):
+                base = (cpu.reg(rn) & ~3) if rn == PC else cpu.r[rn]
+                cpu.set_reg(rd, base + imm12 if opc == 0 else base - imm12)
+                cpu.cycles += t['alu']
+            return op
+
+        if opc in (4, 12):
+            imm16 = ((hw1 & 15) << 12) | imm12
+
+            def op(cpu):
+                if opc == 4:
+                    cpu.r[rd] = imm16
+                else:
+                    cpu.r[rd] = (cpu.r[rd] & 0xFFFF) | (imm16 << 16)
+                cpu.cycles += t['alu']
+            return op
+
+        lsb = (((hw2 >> 12) & 7) << 2) | ((hw2 >> 6) & 3)
+        width = (hw2 & 31) + 1
+
+        if opc in (20, 28):
+            def op(cpu):
+                value = (cpu.r[rn] >> lsb) & ((1 << width) - 1)
+                cpu.r[rd] = (sign_extend(value, width) & MASK32) if opc == 20 else value
+                cpu.cycles += t['alu']
+            return op
+
+        if opc == 22:
+            msb = hw2 & 31
+
+            def op(cpu):
+                mask = ((1 << (msb - lsb + 1)) - 1) << lsb
+                source = 0 if rn == PC else cpu.r[rn] << lsb
+                cpu.r[rd] = (cpu.r[rd] & ~mask & MASK32) | (source & mask)
+                cpu.cycles += t['alu']
+            return op
+
+        if opc in (16, 24):
+            saturate = (hw2 & 31) + 1
+            kind = 2 if (hw1 >> 5) & 1 else 0
+
+            def op(cpu):
+                value, _ = shift_c(cpu.r[rn], kind, lsb, cpu.c)
+                value = sign_extend(value, 32)
+                if opc == 16:
+                    high, low = (1 << (saturate - 1)) - 1, -(1 << (saturate - 1))
+                else:
+                    high, low = (1 << (hw2 & 31)) - 1, 0
+                cpu.r[rd] = max(low, min(high, value)) & MASK32
+                cpu.cycles += t['alu']
+            return op
+
+        return self.undefined(hw1, hw2)
+
+    def decode_branch_misc(self, hw1, hw2):
+        t = self.t
+        op1 = (hw2 >> 12) & 7
+        s = (hw1 >> 10) & 1
+        j1 = (hw2 >> 13) & 1
+        j2 = (hw2 >> 11) & 1
+
+        if op1 & 5 == 5:
+            i1 = 1 - (j1 ^ s)
+            i2 = 1 - (j2 ^ s)
+            offset = sign_extend((s << 24) | (i1 << 23) | (i2 << 22) | ((hw1 & 0x3FF) << 12) | ((hw2 & 0x7FF) << 1), 25)
+
+            def op(cpu):
+                cpu.r[LR] = (cpu.pc + 4) | 1
+                cpu.npc = (cpu.pc + 4 + offset) & MASK32
+                cpu.cycles += t['bl']
+            return op
+
+        if not self.v7:
+            # MSR, MRS and the barriers are the only other ARMv6-M 32-bit instructions
+            if op1 & 5 == 0 and (hw1 & 0xFFE0) in (0xF380, 0xF3E0) or (hw1 & 0xFFF0) == 0xF3B0:
+                return self.decode_misc_control(hw1, hw2)
+            return self.undefined(hw1, hw2)
+
+        if op1 & 5 == 1:
+            i1 = 1 - (j1 ^ s)
+            i2 = 1 - (j2 ^ s)
+            offset = sign_extend((s << 24) | (i1 << 23) | (i2 << 22) | ((hw1 & 0x3FF) << 12) | ((hw2 & 0x7FF) << 1), 25)
+
+            def op(cpu):
+                cpu.npc = (cpu.pc + 4 + offset) & MASK32
+                cpu.cycles += t['branch']
+            return op
+
+        if op1 & 5 == 0:
+            cond = (hw1 >> 6) & 15
+            if (cond >> 1) != 7:
+                offset = sign_extend((s << 20) | (j2 << 19) | (j1 << 18) | ((hw1 & 0x3F) << 12) | ((hw2 & 0x7FF) << 1), 21)
+
+                def op(cpu):
+                    if cpu.condition(cond):
+                        cpu.npc = (cpu.pc + 4 + offset) & MASK32
+                        cpu.cycles += t['branch']
+                    else:
+                        cpu.cycles += 1
+                return op
+            return self.decode_misc_control(hw1, hw2)
+
+        return self.undefined(hw1, hw2)
+
+    def decode_misc_control(self, hw1, hw2):
+        sel = (hw1 >> 4) & 0x7F
+        if sel in (0x38, 0x39):
+            # MSR: only the APSR flags are kept, the rest has no effect here
+            rn = hw1 & 15
+            sysm = hw2 & 0xFF
+
+            def op(cpu):
+                if sysm < 4 and (hw2 >> 11) & 1:
+                    value = cpu.r[rn]
+                    cpu.n, cpu.z, cpu.c, cpu.v = (value >> 31) & 1, (value >> 30) & 1, (value >> 29) & 1, (value >> 28) & 1
+                cpu.cycles += 2
+            return op
+        if sel in (0x3E, 0x3F):
+            rd = (hw2 >> 8) & 15
+            sysm = hw2 & 0xFF
+
+            def op(cpu):
+                if sysm < 4:
+                    cpu.r[rd] = (cpu.n << 31) | (cpu.z << 30) | (cpu.c << 29) | (cpu.v << 28)
+                elif sysm in (8, 9):
+                    cpu.r[rd] = cpu.r[SP]
+                else:
+                    cpu.r[rd] = 0
+                cpu.cycles += 2
+            return op
+        if sel in (0x3A, 0x3B):
+            # hints and barriers
+            def op(cpu):
+                cpu.cycles += 1 if sel == 0x3A else 3
+            return op
+        return self.undefined(hw1, hw2)
+
+    def decode_store_single(self, hw1, hw2):
+        size = 1 << ((hw1 >> 5) & 3)
+        rn = hw1 & 15
+        rt = (hw2 >> 12) & 15
+        if size == 8 or rn == PC:
+            return self.undefined(hw1, hw2)
+        return self.single_transfer(hw1, hw2, size, False, False, rn, rt)
+
+    def decode_load_single(self, hw1, hw2):
+        size = 1 << ((hw1 >> 5) & 3)
+        signed = (hw1 >> 8) & 1
+        rn = hw1 & 15
+        rt = (hw2 >> 12) & 15
+        if rt == PC and size < 4:
+            # PLD/PLI
+            def op(cpu):
+                cpu.cycles += 1
+            return op
+        return self.single_transfer(hw1, hw2, size, True, signed, rn, rt)
+
+    def single_transfer(self, hw1, hw2, size, is_load, signed, rn, rt):
+        t = self.t
+        index, add, writeback, shift, rm = 1, 1, 0, 0, None
+        if rn == PC:
+            add = (hw1 >> 7) & 1
+            imm = hw2 & 0xFFF
+        elif (hw1 >> 7) & 1:
+            imm = hw2 & 0xFFF
+        elif (hw2 >> 11) & 1:
+            imm = hw2 & 0xFF
+            index = (hw2 >> 10) & 1
+            add = (hw2 >> 9) & 1
+            writeback = (hw2 >> 8) & 1
+        elif (hw2 & 0xFC0) == 0:
+            imm = 0
+            rm = hw2 & 15
+            shift = (hw2 >> 4) & 3
+        else:
+            return self.undefined(hw1, hw2)
+
+        def op(cpu):
+            base = ((cpu.pc + 4) & ~3) if rn == PC else cpu.r[rn]
+            offset = (cpu.r[rm] << shift) if rm is not None else imm
+            offset_address = (base + offset if add else base - offset) & MASK32
+            address = offset_address if index else base
+            if is_load:
+                value = cpu.load(address, size)
+                if signed:
+                    value = sign_extend(value, 8 * size) & MASK32
+                if writeback:
+                    cpu.r[rn] = offset_address
+                if rt == PC:
+                    cpu.bx_write_pc(value)
+                    cpu.cycles += t['load'] + t['bx']
+                else:
+                    cpu.r[rt] = value
+                    cpu.cycles += t['load']
+            else:
+                cpu.store(address, size, cpu.r[rt])
+                if writeback:
+                    cpu.r[rn] = offset_address
+                cpu.cycles += t['store']
+        return op
+
+    def decode_dp_register(self, hw1, hw2):
+        t = self.t
+        op1 = (hw1 >> 4) & 15
+        op2 = (hw2 >> 4) & 15
+        rn = hw1 & 15
+        rd = (hw2 >> 8) & 15
+        rm = hw2 & 15
+
+        if (hw2 & 0xF0F0) == 0xF000 and op1 < 8:
+            kind = op1 >> 1
+            setflags = op1 & 1
+
+            def op(cpu):
+                result, carry = shift_c(cpu.r[rn], kind, cpu.r[rm] & 0xFF, cpu.c)
+                cpu.r[rd] = result
+                if setflags:
+                    cpu.set_nz(result)
+                    cpu.c = carry
+                cpu.cycles += t['alu']
+            return op
+
+        if (hw2 & 0xF0C0) == 0xF080 and op1 in (0, 1, 4, 5):
+            rotation = ((hw2 >> 4) & 3) << 3
+            bits = 16 if op1 in (0, 1) else 8
+            signed = op1 in (0, 4)
+
+            def op(cpu):
+                value, _ = shift_c(cpu.r[rm], 3, rotation, 0)
+                value &= (1 << bits) - 1
+                if signed:
+                    value = sign_extend(value, bits) & MASK32
+                if rn != PC:
+                    value = (value + cpu.r[rn]) & MASK32
+                cpu.r[rd] = value
+                cpu.cycles += t['alu']
+            return op
+
+        if (hw2 & 0xF0C0) == 0xF080 and op1 in (9, 11):
+            kind = ((op1 & 2) << 1) | (op2 & 3)
+
+            def op(cpu):
+                value = cpu.r[rm]
+                if kind == 0:
+                    value = ((value & 0xFF) << 24) | ((value & 0xFF00) << 8) | ((value >> 8) & 0xFF00) | (value >> 24)
+                elif kind == 1:
+                    value = ((value & 0x00FF00FF) << 8) | ((value >> 8) & 0x00FF00FF)
+                elif kind == 2:
+                    value = int('{0:032b}'.format(value)[::-1], 2)
+                elif kind == 3:
+                    value = sign_extend(((value & 0xFF) << 8) | ((value >> 8) & 0xFF), 16) & MASK32
+                elif kind == 4:
+                    value = 32 - value.bit_length()
+                else:
+                    raise Fault('undefined instruction 0x%04x 0x%04x' % (hw1, hw2), cpu.pc)
+                cpu.r[rd] = value
+                cpu.cycles += t['alu']
+            return op
+
+        return self.undefined(hw1, hw2)
+
+    def decode_multiply(self, hw1, hw2):
+        t = self.t
+        op1 = (hw1 >> 4) & 7
+        op2 = (hw2 >> 4) & 3
+        rn = hw1 & 15
+        ra = (hw2 >> 12) & 15
+        rd = (hw2 >> 8) & 15
+        rm = hw2 & 15
+        if op1 != 0 or op2 > 1:
+            return self.undefined(hw1, hw2)
+
+        def op(cpu):
+            product = cpu.r[rn] * cpu.r[rm]
+            if op2 == 1:
+                cpu.r[rd] = (cpu.r[ra] - product) & MASK32
+            elif ra == PC:
+                cpu.r[rd] = product & MASK32
+            else:
+                cpu.r[rd] = (cpu.r[ra] + product) & MASK32
+            cpu.cycles += t['mul'] if ra == PC and op2 == 0 else t['mul'] + 1
+        return op
+
+    def decode_long_multiply(self, hw1, hw2):
+        t = self.t
+        op1 = (hw1 >> 4) & 7
+        op2 = (hw2 >> 4) & 15
+        rn = hw1 & 15
+        rdlo = (hw2 >> 12) & 15
+        rdhi = (hw2 >> 8) & 15
+        rm = hw2 & 15
+
+        if op2 == 15 and op1 in (1, 3):
+            signed = op1 == 1
+
+            def op(cpu):
+                n, m = cpu.r[rn], cpu.r[rm]
+                if m == 0:
+                    result = 0
+                elif signed:
+                    n, m = sign_extend(n, 32), sign_extend(m, 32)
+                    result = abs(n) // abs(m)
+                    if (n < 0) != (m < 0):
+                        result = -result
+                else:
+                    result = n // m
+                cpu.r[rdhi] = result & MASK32
+                cpu.cycles += t['div']
+            return op
+
+        if op2 == 0 and op1 in (0, 2, 4, 6):
+            signed = op1 in (0, 4)
+            accumulate = op1 in (4, 6)
+
+            def op(cpu):
+                n, m = cpu.r[rn], cpu.r[rm]
+                if signed:
+                    n, m = sign_extend(n, 32), sign_extend(m, 32)
+                result = n * m
+                if accumulate:
+                    result += (cpu.r[rdhi] << 32) | cpu.r[rdlo]
+                result &= (1 << 64) - 1
+                cpu.r[rdlo] = result & MASK32
+                cpu.r[rdhi] = result >> 32
+                cpu.cycles += t['mull']
+            return op
+
+        return self.undefined(hw1, hw2)
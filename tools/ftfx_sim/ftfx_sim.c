@@ -0,0 +1,659 @@
+/* FTFx flash controller simulator
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Model of the FTFx flash controller for host builds of the Freescale algorithm.
+ *
+ * The geometry comes from the *_features.h header of the CPU the model is built
+ * for. A command runs when the driver writes CCIF; its effect on the flash cells
+ * is applied immediately, but CCIF only reads back as set once the configured
+ * latency has elapsed on the simulated clock. The clock advances with every
+ * FSTAT read (pollNs), every launch (launchNs) and with sim_advance().
+ *
+ * Memory-mapped reads see a worst-case cache: flash contents read through the
+ * memory map only change when the driver invalidates the flash cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SSD_FTFx_Common.h"
+#include "flash_densities.h"
+#include "ftfx_sim.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////////////////////////
+
+#define SIM_PFLASH_SIZE     (FSL_FEATURE_FLASH_PFLASH_BLOCK_COUNT * FSL_FEATURE_FLASH_PFLASH_BLOCK_SIZE)
+
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+#define SIM_DFLASH_SIZE     (FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_COUNT * FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_SIZE)
+#define SIM_REGION_COUNT    2
+#else
+#define SIM_REGION_COUNT    1
+#endif
+
+#if FSL_FEATURE_FLASH_HAS_FLEX_RAM
+#define SIM_FLEX_RAM_SIZE   FSL_FEATURE_FLASH_FLEX_RAM_SIZE
+#else
+#define SIM_FLEX_RAM_SIZE   0
+#endif
+
+#if defined(FTFA)
+    #define SIM_FCNFG_EEERDY_MASK   0
+#elif defined(FTFE)
+    #define SIM_FCNFG_EEERDY_MASK   FTFE_FCNFG_EEERDY_MASK
+#elif defined(FTFL)
+    #define SIM_FCNFG_EEERDY_MASK   FTFL_FCNFG_EEERDY_MASK
+#endif
+
+//! @brief Offset of FCCOBn from FCCOB3, see kFCCOBx.
+#define SIM_FCCOB_OFFSET(n) (((n) & ~3) + 3 - ((n) & 3))
+
+//! @brief A flash array: PFlash or the data flash part of FlexNVM.
+typedef struct _sim_region {
+    const char * name;
+    uint32_t mappedBase;        //!< Address in the memory map
+    uint32_t commandBase;       //!< Address in FCCOB
+    uint32_t size;
+    uint32_t blockSize;
+    uint32_t sectorSize;
+    uint8_t * cells;            //!< Contents of the flash array
+    uint8_t * cached;           //!< Contents seen through the memory map
+} sim_region_t;
+
+////////////////////////////////////////////////////////////////////////////////
+// Variables
+////////////////////////////////////////////////////////////////////////////////
+
+sim_ftfx_t g_simFtfx;
+SIM_Type g_simSim;
+#if defined(WDOG) || defined(WDOG0)
+WDOG_Type g_simWdog;
+#endif
+#if defined(MCM) || defined(MCM0)
+MCM_Type g_simMcm;
+#endif
+#if defined(FMC)
+FMC_Type g_simFmc;
+#endif
+
+const sim_timing_t kSimDefaultTiming = {
+    .pollNs = 100,
+    .launchNs = 200,
+    .program4Ns = 65000,
+    .program8Ns = 90000,
+    .programSectionNs = 50000,
+    .programSectionUnitNs = 20000,
+    .eraseSectorNs = 14000000,
+    .eraseBlockNs = 225000000,
+    .eraseAllNs = 450000000,
+    .verifySectionNs = 5000,
+    .verifySectionUnitNs = 100,
+    .verifyBlockNs = 1500000,
+    .programCheckNs = 30000,
+    .setRamNs = 70000,
+};
+
+static uint8_t s_pflash[SIM_PFLASH_SIZE];
+static uint8_t s_pflashCached[SIM_PFLASH_SIZE];
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+static uint8_t s_dflash[SIM_DFLASH_SIZE];
+static uint8_t s_dflashCached[SIM_DFLASH_SIZE];
+#endif
+#if SIM_FLEX_RAM_SIZE
+static uint8_t s_flexRam[SIM_FLEX_RAM_SIZE];
+#endif
+
+static sim_region_t s_regions[SIM_REGION_COUNT];
+
+static struct {
+    sim_timing_t timing;
+    sim_stats_t stats;
+    uint64_t now;               //!< Simulated clock
+    uint64_t doneAt;            //!< Completion time of the running command
+    bool busy;
+    uint8_t pendingStatus;      //!< FSTAT bits set when the running command completes
+    uint8_t launchFccob[12];    //!< FCCOB contents when the running command was launched
+    int trace;
+} s_sim;
+
+////////////////////////////////////////////////////////////////////////////////
+// Code
+////////////////////////////////////////////////////////////////////////////////
+
+//! @brief Report a misuse of the controller by the driver.
+static void sim_violation(const char * what, uint32_t address)
+{
+    s_sim.stats.violations++;
+    fprintf(stderr, "ftfx_sim: %s (address 0x%08x)\n", what, address);
+}
+
+//! @brief Pick up cache invalidations written by flash_cache_clear().
+static void sim_sync_cache(void)
+{
+    bool invalidated = false;
+
+#if FSL_FEATURE_FLASH_HAS_MCM_FLASH_CACHE_CONTROLS
+    if (g_simMcm.PLACR & MCM_PLACR_CFCC_MASK)
+    {
+        g_simMcm.PLACR &= ~MCM_PLACR_CFCC_MASK;
+        invalidated = true;
+    }
+#elif defined(CPU_MK66FN2M0VLQ18) || defined(CPU_MK65FN2M0VMI18)
+    if (g_simFmc.PFB01CR & FMC_PFB01CR_CINV_WAY_MASK)
+    {
+        g_simFmc.PFB01CR &= ~FMC_PFB01CR_CINV_WAY_MASK;
+        invalidated = true;
+    }
+#elif FSL_FEATURE_FLASH_HAS_FMC_FLASH_CACHE_CONTROLS
+    if (g_simFmc.PFB0CR & FMC_PFB0CR_CINV_WAY_MASK)
+    {
+        g_simFmc.PFB0CR &= ~FMC_PFB0CR_CINV_WAY_MASK;
+        invalidated = true;
+    }
+#endif
+
+    if (invalidated)
+    {
+        s_sim.stats.cacheInvalidates++;
+        for (int i = 0; i < SIM_REGION_COUNT; i++)
+        {
+            memcpy(s_regions[i].cached, s_regions[i].cells, s_regions[i].size);
+        }
+    }
+}
+
+//! @brief Find the region holding [address, address + length) in FCCOB address space.
+static sim_region_t * sim_find_region(uint32_t address, uint32_t length, uint32_t * offset)
+{
+    for (int i = 0; i < SIM_REGION_COUNT; i++)
+    {
+        sim_region_t * region = &s_regions[i];
+        if ((address >= region->commandBase)
+            && ((uint64_t)address + length <= (uint64_t)region->commandBase + region->size))
+        {
+            *offset = address - region->commandBase;
+            return region;
+        }
+    }
+    return NULL;
+}
+
+//! @brief Find the region holding a memory-mapped address.
+static sim_region_t * sim_find_mapped_region(uint32_t address)
+{
+    for (int i = 0; i < SIM_REGION_COUNT; i++)
+    {
+        sim_region_t * region = &s_regions[i];
+        if ((address >= region->mappedBase) && (address - region->mappedBase < region->size))
+        {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+static bool sim_is_blank(const sim_region_t * region, uint32_t offset, uint32_t length)
+{
+    while (length--)
+    {
+        if (region->cells[offset++] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void sim_program(sim_region_t * region, uint32_t offset, const uint8_t * data, uint32_t length)
+{
+    if (!sim_is_blank(region, offset, length))
+    {
+        sim_violation("programming flash that is not erased", region->mappedBase + offset);
+    }
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        region->cells[offset + i] &= data[i];
+    }
+}
+
+static uint16_t sim_fccob_count(const uint8_t * fccob)
+{
+    return (fccob[SIM_FCCOB_OFFSET(4)] << 8) | fccob[SIM_FCCOB_OFFSET(5)];
+}
+
+//! @brief Run the command in FCCOB.
+//!
+//! @return The FSTAT error bits to raise right away. MGSTAT0 is left in
+//!         s_sim.pendingStatus and *latency is set to the command duration.
+static uint8_t sim_execute(const uint8_t * fccob, uint32_t * latency)
+{
+    const sim_timing_t * timing = &s_sim.timing;
+    uint8_t command = fccob[SIM_FCCOB_OFFSET(0)];
+    uint32_t address = (fccob[SIM_FCCOB_OFFSET(1)] << 16) | (fccob[SIM_FCCOB_OFFSET(2)] << 8) | fccob[SIM_FCCOB_OFFSET(3)];
+    sim_region_t * region;
+    uint32_t offset;
+    uint32_t length;
+
+    s_sim.stats.commands[command]++;
+    s_sim.stats.commandCount++;
+    *latency = 0;
+
+    if (s_sim.trace > 1)
+    {
+        printf("    %-6s 0x%06x\n", sim_command_name(command), address);
+    }
+
+    switch (command)
+    {
+        case FTFx_PROGRAM_LONGWORD:
+        case FTFx_PROGRAM_PHRASE:
+            length = (command == FTFx_PROGRAM_LONGWORD) ? 4 : 8;
+            if ((length != FSL_FEATURE_FLASH_PFLASH_BLOCK_WRITE_UNIT_SIZE) || (address % length)
+                || !(region = sim_find_region(address, length, &offset)))
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            sim_program(region, offset, &fccob[4], length);
+            *latency = (length == 4) ? timing->program4Ns : timing->program8Ns;
+            return 0;
+
+#if SIM_FLEX_RAM_SIZE
+        case FTFx_PROGRAM_SECTION:
+            length = sim_fccob_count(fccob) * FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT;
+            if (!(g_simFtfx.FCNFG & FTFx_FCNFG_RAMRDY_MASK)
+                || !length || (length > SIM_FLEX_RAM_SIZE)
+                || (address % FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT)
+                || !(region = sim_find_region(address, length, &offset))
+                || ((offset / region->sectorSize) != ((offset + length - 1) / region->sectorSize)))
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            sim_program(region, offset, s_flexRam, length);
+            *latency = timing->programSectionNs + sim_fccob_count(fccob) * timing->programSectionUnitNs;
+            return 0;
+#endif
+
+        case FTFx_ERASE_SECTOR:
+            if ((address % FSL_FEATURE_FLASH_PFLASH_SECTOR_CMD_ADDRESS_ALIGMENT)
+                || !(region = sim_find_region(address, 1, &offset)))
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            memset(&region->cells[ALIGN_DOWN(offset, region->sectorSize)], 0xFF, region->sectorSize);
+            *latency = timing->eraseSectorNs;
+            return 0;
+
+        case FTFx_ERASE_BLOCK:
+            if ((address % FSL_FEATURE_FLASH_PFLASH_BLOCK_CMD_ADDRESS_ALIGMENT)
+                || !(region = sim_find_region(address, 1, &offset)))
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            memset(&region->cells[ALIGN_DOWN(offset, region->blockSize)], 0xFF, region->blockSize);
+            *latency = timing->eraseBlockNs;
+            return 0;
+
+        case FTFx_ERASE_ALL_BLOCK:
+            for (int i = 0; i < SIM_REGION_COUNT; i++)
+            {
+                memset(s_regions[i].cells, 0xFF, s_regions[i].size);
+            }
+            *latency = timing->eraseAllNs;
+            return 0;
+
+        case FTFx_VERIFY_SECTION:
+            length = sim_fccob_count(fccob) * FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT;
+            if (!length || (fccob[SIM_FCCOB_OFFSET(6)] > 2)
+                || (address % FSL_FEATURE_FLASH_PFLASH_SECTION_CMD_ADDRESS_ALIGMENT)
+                || !(region = sim_find_region(address, length, &offset))
+                || ((offset / region->blockSize) != ((offset + length - 1) / region->blockSize)))
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            s_sim.pendingStatus = sim_is_blank(region, offset, length) ? 0 : FTFx_FSTAT_MGSTAT0_MASK;
+            *latency = timing->verifySectionNs + sim_fccob_count(fccob) * timing->verifySectionUnitNs;
+            return 0;
+
+        case FTFx_VERIFY_BLOCK:
+            if ((fccob[SIM_FCCOB_OFFSET(4)] > 2) || !(region = sim_find_region(address, 1, &offset)))
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            offset = ALIGN_DOWN(offset, region->blockSize);
+            s_sim.pendingStatus = sim_is_blank(region, offset, region->blockSize) ? 0 : FTFx_FSTAT_MGSTAT0_MASK;
+            *latency = timing->verifyBlockNs;
+            return 0;
+
+        case FTFx_VERIFY_ALL_BLOCK:
+            if (fccob[SIM_FCCOB_OFFSET(1)] > 2)
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            for (int i = 0; i < SIM_REGION_COUNT; i++)
+            {
+                if (!sim_is_blank(&s_regions[i], 0, s_regions[i].size))
+                {
+                    s_sim.pendingStatus = FTFx_FSTAT_MGSTAT0_MASK;
+                }
+            }
+            *latency = timing->verifyBlockNs * SIM_REGION_COUNT;
+            return 0;
+
+        case FTFx_PROGRAM_CHECK:
+            if ((address % FSL_FEATURE_FLASH_PFLASH_CHECK_CMD_ADDRESS_ALIGMENT)
+                || (fccob[SIM_FCCOB_OFFSET(4)] < 1) || (fccob[SIM_FCCOB_OFFSET(4)] > 2)
+                || !(region = sim_find_region(address, 4, &offset)))
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            s_sim.pendingStatus = memcmp(&region->cells[offset], &fccob[8], 4) ? FTFx_FSTAT_MGSTAT0_MASK : 0;
+            *latency = timing->programCheckNs;
+            return 0;
+
+#if FSL_FEATURE_FLASH_HAS_SET_FLEXRAM_FUNCTION_CMD
+        case FTFx_SET_FLEXRAM_FUNCTION:
+            if (fccob[SIM_FCCOB_OFFSET(1)] == 0xFF)
+            {
+                g_simFtfx.FCNFG = (g_simFtfx.FCNFG & ~SIM_FCNFG_EEERDY_MASK) | FTFx_FCNFG_RAMRDY_MASK;
+            }
+            else if (fccob[SIM_FCCOB_OFFSET(1)] == 0x00)
+            {
+                g_simFtfx.FCNFG = (g_simFtfx.FCNFG & ~FTFx_FCNFG_RAMRDY_MASK) | SIM_FCNFG_EEERDY_MASK;
+            }
+            else
+            {
+                return FTFx_FSTAT_ACCERR_MASK;
+            }
+            *latency = timing->setRamNs;
+            return 0;
+#endif
+
+        default:
+            return FTFx_FSTAT_ACCERR_MASK;
+    }
+}
+
+//! @brief Complete the running command once its latency has elapsed.
+static void sim_update(void)
+{
+    if (s_sim.busy && (s_sim.now >= s_sim.doneAt))
+    {
+        s_sim.busy = false;
+        g_simFtfx.FSTAT |= FTFx_FSTAT_CCIF_MASK | s_sim.pendingStatus;
+
+        if (memcmp(s_sim.launchFccob, (const void *)&g_simFtfx.FCCOB3, sizeof(s_sim.launchFccob)))
+        {
+            sim_violation("FCCOB written while a command was running", 0);
+        }
+    }
+}
+
+// See ftfx_sim.h for documentation of this function.
+uint8_t sim_fstat_read(void)
+{
+    sim_sync_cache();
+    s_sim.now += s_sim.timing.pollNs;
+    s_sim.stats.polls++;
+    sim_update();
+    return g_simFtfx.FSTAT;
+}
+
+// See ftfx_sim.h for documentation of this function.
+void sim_fstat_write(uint8_t value)
+{
+    sim_sync_cache();
+    sim_update();
+
+    // error flags are write 1 to clear
+    g_simFtfx.FSTAT &= ~(value & (FTFx_FSTAT_ACCERR_MASK | FTFx_FSTAT_FPVIOL_MASK | FTFx_FSTAT_RDCOLERR_MASK));
+
+    if (!(value & FTFx_FSTAT_CCIF_MASK))
+    {
+        return;
+    }
+
+    if (s_sim.busy)
+    {
+        sim_violation("CCIF written while a command was running", 0);
+        return;
+    }
+
+    if (g_simFtfx.FSTAT & (FTFx_FSTAT_ACCERR_MASK | FTFx_FSTAT_FPVIOL_MASK))
+    {
+        sim_violation("command launched without clearing ACCERR/FPVIOL", 0);
+        return;
+    }
+
+    uint32_t latency;
+    memcpy(s_sim.launchFccob, (const void *)&g_simFtfx.FCCOB3, sizeof(s_sim.launchFccob));
+    g_simFtfx.FSTAT &= ~FTFx_FSTAT_MGSTAT0_MASK;
+    s_sim.pendingStatus = 0;
+    s_sim.now += s_sim.timing.launchNs;
+
+    uint8_t error = sim_execute(s_sim.launchFccob, &latency);
+    if (error)
+    {
+        s_sim.stats.errors++;
+        g_simFtfx.FSTAT |= error;
+        return;
+    }
+
+    g_simFtfx.FSTAT &= ~FTFx_FSTAT_CCIF_MASK;
+    s_sim.busy = true;
+    s_sim.doneAt = s_sim.now + latency;
+    s_sim.stats.busyNs += latency;
+}
+
+// See ftfx_sim.h for documentation of this function.
+uintptr_t sim_map_address(uint32_t address)
+{
+    sim_sync_cache();
+
+#if SIM_FLEX_RAM_SIZE
+    if ((address >= FSL_FEATURE_FLASH_FLEX_RAM_START_ADDRESS)
+        && (address - FSL_FEATURE_FLASH_FLEX_RAM_START_ADDRESS < SIM_FLEX_RAM_SIZE))
+    {
+        return (uintptr_t)&s_flexRam[address - FSL_FEATURE_FLASH_FLEX_RAM_START_ADDRESS];
+    }
+#endif
+
+    sim_region_t * region = sim_find_mapped_region(address);
+    if (!region)
+    {
+        fprintf(stderr, "ftfx_sim: memory-mapped access outside of flash (address 0x%08x)\n", address);
+        abort();
+    }
+
+    return (uintptr_t)&region->cached[address - region->mappedBase];
+}
+
+// See ftfx_sim.h for documentation of this function.
+void sim_reset(const sim_timing_t * timing, uint8_t fill, bool flexRamForEeprom)
+{
+    memset(&s_sim, 0, sizeof(s_sim));
+    s_sim.timing = *timing;
+
+    memset(&g_simFtfx, 0, sizeof(g_simFtfx));
+    memset(&g_simSim, 0, sizeof(g_simSim));
+    g_simFtfx.FSTAT = FTFx_FSTAT_CCIF_MASK;
+#if SIM_FLEX_RAM_SIZE
+    g_simFtfx.FCNFG = flexRamForEeprom ? SIM_FCNFG_EEERDY_MASK : FTFx_FCNFG_RAMRDY_MASK;
+    memset(s_flexRam, 0, sizeof(s_flexRam));
+#else
+    (void)flexRamForEeprom;
+#endif
+
+    // report the full PFlash size in SIM_FCFG1.PFSIZE
+    for (uint32_t pfsize = 0; pfsize < 16; pfsize++)
+    {
+        if (((uint32_t)kFlashDensities[pfsize] << 12) == SIM_PFLASH_SIZE)
+        {
+            SIM_FCFG1_REG(SIM) |= pfsize << SIM_FCFG1_PFSIZE_SHIFT;
+            break;
+        }
+    }
+
+    s_regions[0] = (sim_region_t) {
+        .name = "PFlash",
+        .mappedBase = FLASH_BLOCK_BASE,
+        .commandBase = FLASH_BLOCK_BASE,
+        .size = SIM_PFLASH_SIZE,
+        .blockSize = FSL_FEATURE_FLASH_PFLASH_BLOCK_SIZE,
+        .sectorSize = FSL_FEATURE_FLASH_PFLASH_BLOCK_SECTOR_SIZE,
+        .cells = s_pflash,
+        .cached = s_pflashCached,
+    };
+
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+    // partition all of FlexNVM as data flash, as set by SIM_FCFG1.DEPART
+    static const uint32_t kDFlashSizeForDepart[] = {
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0000,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0001,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0010,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0011,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0100,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0101,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0110,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_0111,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1000,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1001,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1010,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1011,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1100,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1101,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1110,
+        FSL_FEATURE_FLASH_FLEX_NVM_DFLASH_SIZE_FOR_DEPART_1111
+    };
+    for (uint32_t depart = 0; depart < 16; depart++)
+    {
+        if (kDFlashSizeForDepart[depart] == SIM_DFLASH_SIZE)
+        {
+            SIM_FCFG1_REG(SIM) |= depart << SIM_FCFG1_DEPART_SHIFT;
+            break;
+        }
+    }
+
+    s_regions[1] = (sim_region_t) {
+        .name = "FlexNVM",
+        .mappedBase = FSL_FEATURE_FLASH_FLEX_NVM_START_ADDRESS,
+        .commandBase = FLASH_DFLASH_COMMAND_BASE,
+        .size = SIM_DFLASH_SIZE,
+        .blockSize = FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_SIZE,
+        .sectorSize = FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_SECTOR_SIZE,
+        .cells = s_dflash,
+        .cached = s_dflashCached,
+    };
+#endif
+
+    for (int i = 0; i < SIM_REGION_COUNT; i++)
+    {
+        memset(s_regions[i].cells, fill, s_regions[i].size);
+        memset(s_regions[i].cached, fill, s_regions[i].size);
+    }
+}
+
+// See ftfx_sim.h for documentation of this function.
+void sim_load(uint32_t address, const uint8_t * data, uint32_t length)
+{
+    sim_region_t * region = sim_find_mapped_region(address);
+    if (!region || (address - region->mappedBase + length > region->size))
+    {
+        fprintf(stderr, "ftfx_sim: cannot load 0x%x bytes at 0x%08x\n", length, address);
+        abort();
+    }
+
+    // contents written behind the controller's back are also what the cache holds
+    memcpy(&region->cells[address - region->mappedBase], data, length);
+    memcpy(&region->cached[address - region->mappedBase], data, length);
+}
+
+// See ftfx_sim.h for documentation of this function.
+void sim_read(uint32_t address, uint8_t * data, uint32_t length)
+{
+    sim_region_t * region = sim_find_mapped_region(address);
+    if (!region || (address - region->mappedBase + length > region->size))
+    {
+        fprintf(stderr, "ftfx_sim: cannot read 0x%x bytes at 0x%08x\n", length, address);
+        abort();
+    }
+
+    memcpy(data, &region->cells[address - region->mappedBase], length);
+}
+
+// See ftfx_sim.h for documentation of this function.
+void sim_advance(uint32_t ns)
+{
+    s_sim.now += ns;
+}
+
+// See ftfx_sim.h for documentation of this function.
+void sim_get_stats(sim_stats_t * stats)
+{
+    sim_sync_cache();
+    *stats = s_sim.stats;
+    stats->elapsedNs = s_sim.now;
+}
+
+// See ftfx_sim.h for documentation of this function.
+void sim_stats_diff(sim_stats_t * after, const sim_stats_t * before)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        after->commands[i] -= before->commands[i];
+    }
+    after->commandCount -= before->commandCount;
+    after->busyNs -= before->busyNs;
+    after->elapsedNs -= before->elapsedNs;
+    after->polls -= before->polls;
+    after->cacheInvalidates -= before->cacheInvalidates;
+    after->errors -= before->errors;
+    after->violations -= before->violations;
+}
+
+// See ftfx_sim.h for documentation of this function.
+const char * sim_command_name(uint8_t command)
+{
+    switch (command)
+    {
+        case FTFx_VERIFY_BLOCK:             return "RD1BLK";
+        case FTFx_VERIFY_SECTION:           return "RD1SEC";
+        case FTFx_PROGRAM_CHECK:            return "PGMCHK";
+        case FTFx_READ_RESOURCE:            return "RDRSRC";
+        case FTFx_PROGRAM_LONGWORD:         return "PGM4";
+        case FTFx_PROGRAM_PHRASE:           return "PGM8";
+        case FTFx_ERASE_BLOCK:              return "ERSBLK";
+        case FTFx_ERASE_SECTOR:             return "ERSSCR";
+        case FTFx_PROGRAM_SECTION:          return "PGMSEC";
+        case FTFx_VERIFY_ALL_BLOCK:         return "RD1ALL";
+        case FTFx_READ_ONCE:                return "RDONCE";
+        case FTFx_PROGRAM_ONCE:             return "PGMONCE";
+        case FTFx_ERASE_ALL_BLOCK:          return "ERSALL";
+        case FTFx_SECURITY_BY_PASS:         return "VFYKEY";
+        case FTFx_ERASE_ALL_BLOCK_UNSECURE: return "ERSALLU";
+        case FTFx_SET_FLEXRAM_FUNCTION:     return "SETRAM";
+        default:                            return "?";
+    }
+}
+
+// See ftfx_sim.h for documentation of this function.
+void sim_set_trace(int level)
+{
+    s_sim.trace = level;
+}
@@ -0,0 +1,87 @@
+/* FTFx flash controller simulator
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FTFX_SIM_H_
+#define _FTFX_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//! @brief Command latencies and CPU costs used by the model, in nanoseconds.
+typedef struct _sim_timing {
+    uint32_t pollNs;                //!< CPU time of one FSTAT read
+    uint32_t launchNs;              //!< CPU time of the FSTAT writes launching a command
+    uint32_t program4Ns;            //!< PGM4
+    uint32_t program8Ns;            //!< PGM8
+    uint32_t programSectionNs;      //!< PGMSEC, fixed part
+    uint32_t programSectionUnitNs;  //!< PGMSEC, per section unit
+    uint32_t eraseSectorNs;         //!< ERSSCR
+    uint32_t eraseBlockNs;          //!< ERSBLK
+    uint32_t eraseAllNs;            //!< ERSALL
+    uint32_t verifySectionNs;       //!< RD1SEC, fixed part
+    uint32_t verifySectionUnitNs;   //!< RD1SEC, per section unit
+    uint32_t verifyBlockNs;         //!< RD1BLK and RD1ALL
+    uint32_t programCheckNs;        //!< PGMCHK
+    uint32_t setRamNs;              //!< SETRAM
+} sim_timing_t;
+
+//! @brief Counters accumulated by the model.
+typedef struct _sim_stats {
+    uint32_t commands[256];         //!< Commands launched, by command code
+    uint32_t commandCount;          //!< Commands launched
+    uint64_t busyNs;                //!< Time the controller was busy
+    uint64_t elapsedNs;             //!< Simulated time, CPU and controller
+    uint32_t polls;                 //!< FSTAT reads
+    uint32_t cacheInvalidates;      //!< Flash cache invalidations seen
+    uint32_t errors;                //!< Commands that failed with ACCERR or FPVIOL
+    uint32_t violations;            //!< Driver misbehaviour, see sim_violation()
+} sim_stats_t;
+
+//! @brief Default latencies, typical values from the K series data sheets.
+extern const sim_timing_t kSimDefaultTiming;
+
+//! @brief Reset the controller and fill every flash region with @a fill.
+void sim_reset(const sim_timing_t * timing, uint8_t fill, bool flexRamForEeprom);
+
+//! @brief Write flash contents directly, without going through the controller.
+void sim_load(uint32_t address, const uint8_t * data, uint32_t length);
+
+//! @brief Read the flash cells directly, bypassing the cache model.
+void sim_read(uint32_t address, uint8_t * data, uint32_t length);
+
+//! @brief Account CPU time spent outside of the driver, e.g. in a callback.
+void sim_advance(uint32_t ns);
+
+//! @brief Take a copy of the counters.
+void sim_get_stats(sim_stats_t * stats);
+
+//! @brief Subtract @a before from @a after.
+void sim_stats_diff(sim_stats_t * after, const sim_stats_t * before);
+
+//! @brief Mnemonic of an FTFx command code.
+const char * sim_command_name(uint8_t command);
+
+//! @brief Set the verbosity of the model, 0 only reports violations.
+void sim_set_trace(int level);
+
+//! @name Hooks used by the driver, see include/fsl_device_registers.h
+//@{
+uint8_t sim_fstat_read(void);
+void sim_fstat_write(uint8_t value);
+uintptr_t sim_map_address(uint32_t address);
+//@}
+
+#endif /* _FTFX_SIM_H_ */
@@ -0,0 +1,11 @@
+/* Host stand-in for the CMSIS core header, see ../README.md */
+#ifndef __CORE_CM0PLUS_H_GENERIC
+#define __CORE_CM0PLUS_H_GENERIC
+
+#include <stdint.h>
+
+#define __I     volatile const
+#define __O     volatile
+#define __IO    volatile
+
+#endif
@@ -0,0 +1,85 @@
+/* FTFx flash controller simulator
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host build of the Freescale algorithm: the real device headers are used
+ * unchanged and the peripherals the driver touches are redirected to the
+ * register images owned by ftfx_sim.c. FSTAT and memory-mapped flash accesses
+ * go through the model so that it can run commands and count polls.
+ */
+
+#ifndef _FTFX_SIM_DEVICE_REGISTERS_H_
+#define _FTFX_SIM_DEVICE_REGISTERS_H_
+
+#include_next "fsl_device_registers.h"
+#include "ftfx_sim.h"
+
+#if defined(FTFA)
+    typedef FTFA_Type sim_ftfx_t;
+    #undef FTFA
+    #define FTFA (&g_simFtfx)
+#elif defined(FTFE)
+    typedef FTFE_Type sim_ftfx_t;
+    #undef FTFE
+    #define FTFE (&g_simFtfx)
+#elif defined(FTFL)
+    typedef FTFL_Type sim_ftfx_t;
+    #undef FTFL
+    #define FTFL (&g_simFtfx)
+#else
+    #error "Unknown flash controller"
+#endif
+extern sim_ftfx_t g_simFtfx;
+
+extern SIM_Type g_simSim;
+#undef SIM
+#define SIM (&g_simSim)
+
+#if defined(WDOG)
+extern WDOG_Type g_simWdog;
+#undef WDOG
+#define WDOG (&g_simWdog)
+#endif
+
+#if defined(WDOG0)
+extern WDOG_Type g_simWdog;
+#undef WDOG0
+#define WDOG0 (&g_simWdog)
+#endif
+
+#if defined(MCM)
+extern MCM_Type g_simMcm;
+#undef MCM
+#define MCM (&g_simMcm)
+#endif
+
+#if defined(MCM0)
+extern MCM_Type g_simMcm;
+#undef MCM0
+#define MCM0 (&g_simMcm)
+#endif
+
+#if defined(FMC)
+extern FMC_Type g_simFmc;
+#undef FMC
+#define FMC (&g_simFmc)
+#endif
+
+// Route the driver's FSTAT and memory-mapped accesses through the model
+#define FTFx_FSTAT_RD(x)            sim_fstat_read()
+#define FTFx_FSTAT_WR(x, v)         sim_fstat_write(v)
+#define FLASH_MAPPED_ADDRESS(a)     sim_map_address(a)
+
+#endif /* _FTFX_SIM_DEVICE_REGISTERS_H_ */
@@ -0,0 +1,697 @@
+/* FTFx flash controller simulator
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Runs the Freescale algorithm entry points the way a debugger does and
+ * reports, for every phase, the simulated time, the flash commands issued and
+ * the FSTAT polls. Exits with a non-zero status if the flash contents don't
+ * match, an entry point fails or the driver misuses the controller.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FlashOS.H"
+#include "flash.h"
+#include "crc32.h"
+#include "flash_diff.h"
+#include "flash_stats.h"
+#include "ftfx_sim.h"
+
+// Entry points of FlashPrg.c
+int Init(unsigned long adr, unsigned long clk, unsigned long fnc);
+int UnInit(unsigned long fnc);
+int BlankCheck(unsigned long adr, unsigned long sz, unsigned char pat);
+int EraseSector(unsigned long adr);
+int erase_sector_start(unsigned long adr);
+int erase_poll(void);
+int erase_range(unsigned long adr, unsigned long sz);
+int ProgramPage(unsigned long adr, unsigned long sz, unsigned char *buf);
+unsigned long program_pages(unsigned long adr, unsigned long sz, unsigned char *buf);
+unsigned long Verify(unsigned long adr, unsigned long sz, unsigned char *buf);
+int compute_crc(unsigned long adr, unsigned long sz, unsigned long *crc);
+unsigned long program_sector_if_changed(unsigned long adr, unsigned long sz, unsigned char *buf);
+
+extern struct FlashDeviceV2 const FlashDeviceV2;
+extern flash_driver_t g_flash;
+
+static const struct {
+    const char * name;
+    size_t offset;
+} kTimingFields[] = {
+    { "poll", offsetof(sim_timing_t, pollNs) },
+    { "launch", offsetof(sim_timing_t, launchNs) },
+    { "pgm4", offsetof(sim_timing_t, program4Ns) },
+    { "pgm8", offsetof(sim_timing_t, program8Ns) },
+    { "pgmsec", offsetof(sim_timing_t, programSectionNs) },
+    { "pgmsec_unit", offsetof(sim_timing_t, programSectionUnitNs) },
+    { "ersscr", offsetof(sim_timing_t, eraseSectorNs) },
+    { "ersblk", offsetof(sim_timing_t, eraseBlockNs) },
+    { "ersall", offsetof(sim_timing_t, eraseAllNs) },
+    { "rd1sec", offsetof(sim_timing_t, verifySectionNs) },
+    { "rd1sec_unit", offsetof(sim_timing_t, verifySectionUnitNs) },
+    { "rd1blk", offsetof(sim_timing_t, verifyBlockNs) },
+    { "pgmchk", offsetof(sim_timing_t, programCheckNs) },
+    { "setram", offsetof(sim_timing_t, setRamNs) },
+};
+
+//! @brief Entry points measured separately.
+enum _entry_points {
+    kEntry_Init,
+    kEntry_UnInit,
+    kEntry_BlankCheck,
+    kEntry_EraseSector,
+    kEntry_EraseSectorStart,
+    kEntry_ErasePoll,
+    kEntry_EraseRange,
+    kEntry_ProgramPage,
+    kEntry_ProgramPages,
+    kEntry_Verify,
+    kEntry_ComputeCrc,
+    kEntry_ProgramSectorIfChanged,
+    kEntry_Count
+};
+
+static const char * const kEntryNames[kEntry_Count] = {
+    "Init", "UnInit", "BlankCheck", "EraseSector", "erase_sector_start", "erase_poll", "erase_range",
+    "ProgramPage", "program_pages", "Verify", "compute_crc", "program_sector_if_changed"
+};
+
+//! @brief Index of every entry point in flash_stats.entries.
+static const uint32_t kEntryStats[kEntry_Count] = {
+    FLASH_STATS_INIT, FLASH_STATS_UNINIT, FLASH_STATS_BLANK_CHECK, FLASH_STATS_ERASE_SECTOR,
+    FLASH_STATS_ERASE_SECTOR_START, FLASH_STATS_ERASE_POLL, FLASH_STATS_ERASE_RANGE, FLASH_STATS_PROGRAM_PAGE,
+    FLASH_STATS_PROGRAM_PAGES, FLASH_STATS_VERIFY, FLASH_STATS_COMPUTE_CRC, FLASH_STATS_PROGRAM_SECTOR_IF_CHANGED
+};
+
+//! @brief Call an entry point and account its cost to @a entry.
+#define CALL(entry, call) (call_begin(), call_end(entry, (call)))
+
+static uint32_t s_callbackNs;
+static int s_verbose;
+static int s_programPages;
+static int s_failures;
+static sim_stats_t s_callStart;
+static sim_stats_t s_entryStats[kEntry_Count];
+static uint32_t s_entryCalls[kEntry_Count];
+
+//! @brief Stands in for the work a host does between polls, e.g. servicing USB.
+static void sim_callback(void)
+{
+    sim_advance(s_callbackNs);
+}
+
+//! @brief Timer of flash_stats.c, one cycle per simulated nanosecond.
+uint32_t flash_stats_host_cycles(void)
+{
+    sim_stats_t stats;
+    sim_get_stats(&stats);
+    return (uint32_t)stats.elapsedNs;
+}
+
+//! @brief Size of the sectors of the FlashDeviceV2 region holding @a address.
+static uint32_t sector_size(uint32_t address)
+{
+    const struct FlashRegion * region = FLASH_REGIONS(&FlashDeviceV2);
+    for (uint32_t i = 0; i < FlashDeviceV2.numRegions; i++, region++)
+    {
+        if ((address >= region->adrRegion) && (address - region->adrRegion < region->szRegion))
+        {
+            return region->szSector;
+        }
+    }
+    return 0;
+}
+
+static void call_begin(void)
+{
+    sim_get_stats(&s_callStart);
+}
+
+static unsigned long call_end(int entry, unsigned long result)
+{
+    sim_stats_t stats;
+    sim_get_stats(&stats);
+    sim_stats_diff(&stats, &s_callStart);
+
+    sim_stats_t * total = &s_entryStats[entry];
+    for (int i = 0; i < 256; i++)
+    {
+        total->commands[i] += stats.commands[i];
+    }
+    total->commandCount += stats.commandCount;
+    total->busyNs += stats.busyNs;
+    total->elapsedNs += stats.elapsedNs;
+    total->polls += stats.polls;
+    total->cacheInvalidates += stats.cacheInvalidates;
+    s_entryCalls[entry]++;
+
+    return result;
+}
+
+static void fill_random(uint8_t * data, uint32_t length, uint32_t seed)
+{
+    while (length--)
+    {
+        seed = seed * 1103515245 + 12345;
+        *data++ = seed >> 16;
+    }
+}
+
+// Padded firmware images, the erased value at the end of every page
+static void pad_pages(uint8_t * data, uint32_t length, uint32_t percent)
+{
+    uint32_t pad = FlashDeviceV2.szPage * percent / 100;
+    for (uint32_t page = 0; page < length; page += FlashDeviceV2.szPage)
+    {
+        memset(data + page + FlashDeviceV2.szPage - pad, 0xFF, pad);
+    }
+}
+
+static void fail(const char * phase, const char * what, uint32_t address)
+{
+    fprintf(stderr, "%s: %s at 0x%08x\n", phase, what, address);
+    s_failures++;
+}
+
+static void begin_phase(const char * name, sim_stats_t * before)
+{
+    if (s_verbose)
+    {
+        printf("%s\n", name);
+    }
+    sim_get_stats(before);
+}
+
+static void end_phase(const char * name, const sim_stats_t * before)
+{
+    sim_stats_t stats;
+    sim_get_stats(&stats);
+    sim_stats_diff(&stats, before);
+
+    printf("%-16s %10.3f ms %10.3f ms busy %8u polls %4u cinv ",
+           name, stats.elapsedNs / 1e6, stats.busyNs / 1e6, stats.polls, stats.cacheInvalidates);
+    for (int i = 0; i < 256; i++)
+    {
+        if (stats.commands[i])
+        {
+            printf(" %s:%u", sim_command_name(i), stats.commands[i]);
+        }
+    }
+    printf("\n");
+
+    if (stats.errors || stats.violations)
+    {
+        fprintf(stderr, "%s: %u failed commands, %u violations\n", name, stats.errors, stats.violations);
+        s_failures++;
+    }
+}
+
+//! @brief Program @a image at @a base, one FlashDeviceV2 page or, with -m, one
+//! sector at a time.
+static void program_image(const char * phase, uint32_t base, uint8_t * image, uint32_t length, int skipUnchanged)
+{
+    uint32_t skipped = 0;
+
+    for (uint32_t offset = 0; offset < length; )
+    {
+        uint32_t sectorSize = sector_size(base + offset);
+        uint32_t size = (length - offset < sectorSize) ? length - offset : sectorSize;
+
+        if (skipUnchanged && (CALL(kEntry_Verify, Verify(base + offset, size, &image[offset])) == base + offset + size))
+        {
+            skipped++;
+            offset += size;
+            continue;
+        }
+
+        if (CALL(kEntry_EraseSector, EraseSector(base + offset)))
+        {
+            fail(phase, "EraseSector failed", base + offset);
+        }
+
+        if (s_programPages)
+        {
+            unsigned long result = CALL(kEntry_ProgramPages, program_pages(base + offset, size, &image[offset]));
+            if (result != base + offset + size)
+            {
+                fail(phase, "program_pages failed", result);
+            }
+            offset += size;
+            continue;
+        }
+
+        for (uint32_t page = 0; page < size; page += FlashDeviceV2.szPage)
+        {
+            uint32_t pageSize = (size - page < FlashDeviceV2.szPage) ? size - page : FlashDeviceV2.szPage;
+            if (CALL(kEntry_ProgramPage, ProgramPage(base + offset + page, pageSize, &image[offset + page])))
+            {
+                fail(phase, "ProgramPage failed", base + offset + page);
+            }
+        }
+        offset += size;
+    }
+
+    unsigned long result = CALL(kEntry_Verify, Verify(base, length, image));
+    if (result != base + length)
+    {
+        fail(phase, "Verify failed", result);
+    }
+
+    uint8_t * contents = malloc(length);
+    sim_read(base, contents, length);
+    if (memcmp(contents, image, length))
+    {
+        fail(phase, "flash contents don't match the image", base);
+    }
+    free(contents);
+
+    if (s_verbose && skipUnchanged)
+    {
+        printf("  %u unchanged sectors skipped\n", skipped);
+    }
+}
+
+//! @brief Compare the sector CRCs of @a image at @a base with the ones compute_crc reports.
+static void check_crcs(const char * phase, uint32_t base, const uint8_t * image, uint32_t length)
+{
+    uint32_t count = 0;
+    for (uint32_t offset = 0; offset < length; offset += sector_size(base + offset))
+    {
+        count++;
+    }
+
+    unsigned long * crcs = calloc(count, sizeof(crcs[0]));
+    if (CALL(kEntry_ComputeCrc, compute_crc(base, length, crcs)))
+    {
+        fail(phase, "compute_crc failed", base);
+    }
+    for (uint32_t offset = 0, i = 0; offset < length; offset += sector_size(base + offset), i++)
+    {
+        uint32_t size = (length - offset < sector_size(base + offset)) ? length - offset : sector_size(base + offset);
+        if (crcs[i] != crc32(0, &image[offset], size))
+        {
+            fail(phase, "sector CRC doesn't match the image", base + offset);
+        }
+    }
+    free(crcs);
+}
+
+//! @brief Reflash @a image at @a base with program_sector_if_changed.
+//! @return the number of sectors written, @a erased counts the ones erased
+static uint32_t program_changed(const char * phase, uint32_t base, uint8_t * image, uint32_t length, uint32_t * erased)
+{
+    uint32_t written = 0;
+
+    for (uint32_t offset = 0; offset < length; offset += sector_size(base + offset))
+    {
+        uint32_t size = (length - offset < sector_size(base + offset)) ? length - offset : sector_size(base + offset);
+        unsigned long actions = CALL(kEntry_ProgramSectorIfChanged,
+                                     program_sector_if_changed(base + offset, size, &image[offset]));
+        if (actions & FLASH_ACTION_FAILED)
+        {
+            fail(phase, "program_sector_if_changed failed", base + offset);
+        }
+        written += (actions != 0);
+        *erased += ((actions & FLASH_ACTION_ERASED) != 0);
+    }
+
+    uint8_t * contents = malloc(length);
+    sim_read(base, contents, length);
+    if (memcmp(contents, image, length))
+    {
+        fail(phase, "flash contents don't match the image", base);
+    }
+    free(contents);
+    return written;
+}
+
+static void usage(const char * name)
+{
+    fprintf(stderr,
+            "usage: %s [-s size] [-d size] [-f percent] [-c ns] [-p ns] [-t name=ns] [-e] [-m] [-v]\n"
+            "  -s size    PFlash image size in bytes (default half of PFlash, at most 65536)\n"
+            "  -d size    FlexNVM image size in bytes, where the device has FlexNVM (default 4096)\n"
+            "  -f percent pad the end of every page of the images with that share of 0xFF\n"
+            "  -c ns      register a flash callback costing ns per call\n"
+            "  -p ns      CPU time of one FSTAT poll\n"
+            "  -t name=ns override a command latency:",
+            name);
+    for (size_t i = 0; i < sizeof(kTimingFields) / sizeof(kTimingFields[0]); i++)
+    {
+        fprintf(stderr, " %s", kTimingFields[i].name);
+    }
+    fprintf(stderr,
+            "\n"
+            "  -e         FlexRAM is configured for EEPROM, PGMSEC is not available\n"
+            "  -m         program a sector per program_pages call instead of a page per ProgramPage\n"
+            "  -v         verbose, twice to trace every command\n");
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    sim_timing_t timing = kSimDefaultTiming;
+    uint32_t imageSize = 0;
+    uint32_t dflashImageSize = 0x1000;
+    uint32_t padPercent = 0;
+    bool flexRamForEeprom = false;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:d:f:c:p:t:emv")) != -1)
+    {
+        switch (option)
+        {
+            case 's':
+                imageSize = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                dflashImageSize = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                padPercent = strtoul(optarg, NULL, 0);
+                if (padPercent > 100)
+                {
+                    usage(argv[0]);
+                }
+                break;
+            case 'c':
+                s_callbackNs = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                timing.pollNs = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+            {
+                char * value = strchr(optarg, '=');
+                size_t i;
+                if (!value)
+                {
+                    usage(argv[0]);
+                }
+                *value++ = 0;
+                for (i = 0; i < sizeof(kTimingFields) / sizeof(kTimingFields[0]); i++)
+                {
+                    if (!strcmp(optarg, kTimingFields[i].name))
+                    {
+                        *(uint32_t *)((uint8_t *)&timing + kTimingFields[i].offset) = strtoul(value, NULL, 0);
+                        break;
+                    }
+                }
+                if (i == sizeof(kTimingFields) / sizeof(kTimingFields[0]))
+                {
+                    usage(argv[0]);
+                }
+                break;
+            }
+            case 'e':
+                flexRamForEeprom = true;
+                break;
+            case 'm':
+                s_programPages = 1;
+                break;
+            case 'v':
+                s_verbose++;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+#if FSL_FEATURE_FLASH_HAS_FLEX_NVM
+    uint32_t dflashBase = FSL_FEATURE_FLASH_FLEX_NVM_START_ADDRESS;
+    uint32_t dflashTotal = FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_COUNT * FSL_FEATURE_FLASH_FLEX_NVM_BLOCK_SIZE;
+#else
+    uint32_t dflashBase = 0;
+    uint32_t dflashTotal = 0;
+    dflashImageSize = 0;
+#endif
+    uint32_t pflashTotal = FSL_FEATURE_FLASH_PFLASH_BLOCK_COUNT * FSL_FEATURE_FLASH_PFLASH_BLOCK_SIZE;
+
+    // leave blank sectors behind the image for the erase phases
+    if (!imageSize)
+    {
+        imageSize = (pflashTotal / 2 < 0x10000) ? pflashTotal / 2 : 0x10000;
+    }
+
+    if (!imageSize || (imageSize > pflashTotal) || (imageSize % FlashDeviceV2.szPage)
+        || (dflashImageSize > dflashTotal) || (dflashImageSize % FlashDeviceV2.szPage))
+    {
+        fprintf(stderr, "image sizes must be whole pages within the flash\n");
+        return 2;
+    }
+
+    uint8_t * image = malloc(imageSize);
+    uint8_t * oldImage = malloc(imageSize);
+    uint8_t * dflashImage = malloc(dflashImageSize + 1);
+    fill_random(image, imageSize, 1);
+    fill_random(oldImage, imageSize, 2);
+    fill_random(dflashImage, dflashImageSize, 3);
+    pad_pages(image, imageSize, padPercent);
+    pad_pages(dflashImage, dflashImageSize, padPercent);
+
+    sim_reset(&timing, 0xFF, flexRamForEeprom);
+    sim_set_trace(s_verbose);
+    sim_load(0, oldImage, imageSize);
+
+    printf("%s: PFlash %u KB, sector %u, FlexNVM %u KB, page %u, image %u + %u bytes, callback %u ns\n",
+           FlashDeviceV2.devName, pflashTotal >> 10, sector_size(0), dflashTotal >> 10,
+           FlashDeviceV2.szPage, imageSize, dflashImageSize, s_callbackNs);
+
+    // hosts plan erases with the regions, they have to end where the flash does
+    const struct FlashRegion * region = FLASH_REGIONS(&FlashDeviceV2);
+    if ((FlashDeviceV2.numRegions != (dflashTotal ? 2 : 1))
+        || (region[0].adrRegion != 0) || (region[0].szRegion != pflashTotal)
+        || (dflashTotal && ((region[1].adrRegion != dflashBase) || (region[1].szRegion != dflashTotal))))
+    {
+        fail("FlashDeviceV2", "regions don't match the flash", region[0].szRegion);
+    }
+
+    sim_stats_t before;
+
+    begin_phase("Init", &before);
+    if (CALL(kEntry_Init, Init(0, 0, 2)))
+    {
+        fprintf(stderr, "Init failed\n");
+        return 1;
+    }
+    if (s_callbackNs)
+    {
+        flash_register_callback(&g_flash, sim_callback);
+    }
+    end_phase("Init", &before);
+
+    begin_phase("program", &before);
+    program_image("program", 0, image, imageSize, 0);
+    if (dflashImageSize)
+    {
+        program_image("program", dflashBase, dflashImage, dflashImageSize, 0);
+    }
+    end_phase("program", &before);
+
+    begin_phase("reflash", &before);
+    program_image("reflash", 0, image, imageSize, 1);
+    if (dflashImageSize)
+    {
+        program_image("reflash", dflashBase, dflashImage, dflashImageSize, 1);
+    }
+    end_phase("reflash", &before);
+
+    begin_phase("compute_crc", &before);
+    check_crcs("compute_crc", 0, image, imageSize);
+    if (dflashImageSize)
+    {
+        check_crcs("compute_crc", dflashBase, dflashImage, dflashImageSize);
+    }
+    end_phase("compute_crc", &before);
+
+    // the sectors behind the image are erased already
+    uint32_t blankBase = ALIGN_UP(imageSize, sector_size(0));
+    uint32_t blankSize = (pflashTotal - blankBase < 0x10000) ? pflashTotal - blankBase : 0x10000;
+    begin_phase("erase blank", &before);
+    for (uint32_t offset = 0; offset < blankSize; offset += sector_size(blankBase + offset))
+    {
+        if (CALL(kEntry_EraseSector, EraseSector(blankBase + offset)))
+        {
+            fail("erase blank", "EraseSector failed", blankBase + offset);
+        }
+    }
+    end_phase("erase blank", &before);
+
+    // one byte of the image changes and a blank sector gets new data, only
+    // the image sector needs an erase
+    uint32_t erased = 0;
+    uint32_t written = 0;
+    uint32_t expected = 1;
+    uint8_t * blankImage = malloc(sector_size(blankBase));
+    fill_random(blankImage, sector_size(blankBase), 4);
+    image[imageSize / 2] ^= 0xFF;
+    begin_phase("changed sectors", &before);
+    written += program_changed("changed sectors", 0, image, imageSize, &erased);
+    if (blankSize)
+    {
+        written += program_changed("changed sectors", blankBase, blankImage, sector_size(blankBase), &erased);
+        expected++;
+    }
+    if ((written != expected) || (erased != 1))
+    {
+        fprintf(stderr, "changed sectors: %u sectors written, %u erased\n", written, erased);
+        s_failures++;
+    }
+
+    // new data for the first half of a sector that needs an erase, the second
+    // half holds data and has to be left alone
+    for (uint32_t offset = 0; offset + sector_size(offset) <= imageSize; offset += sector_size(offset))
+    {
+        uint32_t half = sector_size(offset) / 2;
+        uint8_t * update = malloc(half);
+        uint8_t * contents = malloc(2 * half);
+        uint32_t head = 0;
+        uint32_t tail = 0;
+        for (uint32_t i = 0; i < half; i++)
+        {
+            update[i] = ~image[offset + i];
+            head |= (image[offset + i] != 0xFF);
+            tail |= (image[offset + half + i] != 0xFF);
+        }
+        if (head && tail)
+        {
+            unsigned long actions = CALL(kEntry_ProgramSectorIfChanged,
+                                         program_sector_if_changed(offset, half, update));
+            sim_read(offset, contents, 2 * half);
+            if ((actions != FLASH_ACTION_FAILED) || memcmp(contents, &image[offset], 2 * half))
+            {
+                fail("changed sectors", "program_sector_if_changed lost the rest of the sector", offset);
+            }
+        }
+        free(update);
+        free(contents);
+        if (head && tail)
+        {
+            break;
+        }
+    }
+    end_phase("changed sectors", &before);
+    free(blankImage);
+
+    // erase the sectors written above without blocking in the algorithm
+    const uint32_t asyncErase[] = { 0, blankBase };
+    begin_phase("erase async", &before);
+    for (uint32_t i = 0; i < (blankSize ? 2 : 1); i++)
+    {
+        if (CALL(kEntry_EraseSectorStart, erase_sector_start(asyncErase[i])))
+        {
+            fail("erase async", "erase_sector_start failed", asyncErase[i]);
+            continue;
+        }
+
+        int status;
+        while ((status = CALL(kEntry_ErasePoll, erase_poll())) == 1)
+        {
+        }
+        if (status)
+        {
+            fail("erase async", "erase_poll failed", asyncErase[i]);
+        }
+
+        uint32_t size = sector_size(asyncErase[i]);
+        uint8_t * contents = malloc(size);
+        sim_read(asyncErase[i], contents, size);
+        for (uint32_t offset = 0; offset < size; offset++)
+        {
+            if (contents[offset] != 0xFF)
+            {
+                fail("erase async", "sector not erased", asyncErase[i]);
+                break;
+            }
+        }
+        free(contents);
+    }
+    end_phase("erase async", &before);
+
+    begin_phase("erase_range", &before);
+    if (CALL(kEntry_EraseRange, erase_range(0, imageSize)))
+    {
+        fail("erase_range", "erase_range failed", 0);
+    }
+    if (CALL(kEntry_BlankCheck, BlankCheck(0, imageSize, 0xFF)))
+    {
+        fail("erase_range", "BlankCheck failed", 0);
+    }
+    if (CALL(kEntry_BlankCheck, BlankCheck(1, 3, 0xFF)))
+    {
+        fail("erase_range", "unaligned BlankCheck failed", 1);
+    }
+    if (dflashImageSize)
+    {
+        if (CALL(kEntry_EraseRange, erase_range(dflashBase, dflashImageSize))
+            || CALL(kEntry_BlankCheck, BlankCheck(dflashBase, dflashImageSize, 0xFF)))
+        {
+            fail("erase_range", "FlexNVM erase failed", dflashBase);
+        }
+    }
+    end_phase("erase_range", &before);
+
+    begin_phase("UnInit", &before);
+    if (CALL(kEntry_UnInit, UnInit(2)))
+    {
+        fail("UnInit", "UnInit failed", 0);
+    }
+    end_phase("UnInit", &before);
+
+    sim_get_stats(&before);
+    printf("%-16s %10.3f ms %10.3f ms busy %8u polls %4u cinv  %u commands\n",
+           "total", before.elapsedNs / 1e6, before.busyNs / 1e6, before.polls,
+           before.cacheInvalidates, before.commandCount);
+
+    printf("\n%-26s %6s %12s %12s %12s %10s %10s\n", "per call", "calls", "time us", "busy us", "wait us",
+           "commands", "polls");
+    for (int i = 0; i < kEntry_Count; i++)
+    {
+        if (s_entryCalls[i])
+        {
+            uint32_t calls = s_entryCalls[i];
+            const flash_stats_entry_t * entry = &flash_stats.entries[kEntryStats[i]];
+            printf("%-26s %6u %12.1f %12.1f %12.1f %10.1f %10.1f\n", kEntryNames[i], calls,
+                   s_entryStats[i].elapsedNs / 1e3 / calls, s_entryStats[i].busyNs / 1e3 / calls,
+                   entry->wait_cycles / 1e3 / calls,
+                   (double)s_entryStats[i].commandCount / calls, (double)s_entryStats[i].polls / calls);
+
+            // The algorithm's own accounting sees the same calls and time
+            if ((entry->calls != calls) || (entry->cycles != (uint32_t)s_entryStats[i].elapsedNs))
+            {
+                fprintf(stderr, "flash_stats: %s counted %u calls, %u ns\n", kEntryNames[i], entry->calls,
+                        entry->cycles);
+                s_failures++;
+            }
+        }
+    }
+    printf("flash_stats: %u bytes programmed, %u bytes erased\n", flash_stats.bytes_programmed,
+           flash_stats.bytes_erased);
+
+    free(image);
+    free(oldImage);
+    free(dflashImage);
+
+    if (s_failures)
+    {
+        fprintf(stderr, "%d failures\n", s_failures);
+        return 1;
+    }
+    return 0;
+}